@@ -0,0 +1,58 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#ifndef FOU_CAPACITY_H_
+#define FOU_CAPACITY_H_
+
+#include "stdint.h"
+
+namespace fou {
+
+/**
+ *  Compile time selection of a type. Small replacement for
+ *  std::conditional, which is not available on every embedded toolchain.
+ */
+template <bool Condition, typename Then, typename Else>
+struct Select { typedef Then type; };
+
+template <typename Then, typename Else>
+struct Select<false, Then, Else> { typedef Else type; };
+
+/**
+ *  The smallest unsigned type that can hold every index and size of a
+ *  buffer with the given capacity, including the capacity itself.
+ */
+template <uint32_t Capacity>
+struct IndexFor {
+  typedef typename Select<(Capacity <= 0xff), uint8_t,
+          typename Select<(Capacity <= 0xffff), uint16_t, uint32_t>::type>::type type;
+};
+
+} // end namespace fou
+
+#endif
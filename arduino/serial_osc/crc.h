@@ -0,0 +1,160 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#ifndef FOU_CRC_H_
+#define FOU_CRC_H_
+
+#include "stdint.h"
+
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#define FOU_PROGMEM PROGMEM
+#define FOU_READ_U16(table, i) pgm_read_word(&(table)[i])
+#else
+#define FOU_PROGMEM
+#define FOU_READ_U16(table, i) ((table)[i])
+#endif
+
+namespace fou {
+namespace crc {
+
+extern const uint16_t kCrc16Table[256] FOU_PROGMEM;
+
+/**
+ *  Update a CRC-16/CCITT-FALSE register (poly 0x1021, not reflected).
+ */
+uint16_t crc16_update(uint16_t crc, const uint8_t *data, int size);
+
+#ifndef __AVR__
+/**
+ *  CRC-32C byte table, for the inline single byte step.
+ */
+extern const uint32_t kCrc32cTable[256];
+#endif
+
+/**
+ *  Update a CRC-32C (Castagnoli) register, reflected, without the final xor.
+ *  Uses the SSE 4.2 or ARMv8 crc32c instructions when the CPU has them, 
+ *  slice-by-8 tables on other hosts and a bitwise loop on 8 bit targets.
+ */
+uint32_t crc32c_update(uint32_t crc, const uint8_t *data, int size);
+
+/**
+ *  CRC-16/CCITT-FALSE, cheap enough for 8 bit targets: one 512 byte table,
+ *  kept in flash on AVR. The trailer is sent big endian, so a frame with a
+ *  correct trailer leaves the register at 0.
+ *
+ *  Crc16 and Crc32c are used as the Check parameter of the SLIP encoders and
+ *  decoders, and count the frames that failed check().
+ */
+class Crc16 {
+ public:
+    enum { kSize = 2 };
+
+    Crc16() : mCrc(0xffff), mFailures(0) {}
+
+    inline void reset() { mCrc = 0xffff; }
+    inline void update( uint8_t c ) {
+      mCrc = (mCrc << 8) ^ FOU_READ_U16(kCrc16Table, ((mCrc >> 8) ^ c) & 0xff);
+    }
+    inline void update( const uint8_t *data, int size ) { mCrc = crc16_update(mCrc, data, size); }
+    inline uint16_t value() const { return mCrc; }
+
+    /**
+     *  Write the trailer for the data seen so far.
+     */
+    inline void trailer( uint8_t *out ) const {
+      out[0] = mCrc >> 8;
+      out[1] = mCrc & 0xff;
+    }
+    /**
+     *  @return true when the data seen so far, trailer included, is intact.
+     */
+    inline bool check() {
+      if (mCrc == 0) return true;
+      mFailures++;
+      return false;
+    }
+    /**
+     *  Count a frame that failed for another reason, e.g. shorter than a trailer.
+     */
+    inline void fail() { mFailures++; }
+    inline uint32_t failures() const { return mFailures; }
+
+ private:
+    uint16_t mCrc;
+    uint32_t mFailures;
+};
+
+/**
+ *  CRC-32C, for hosts and fast links. The trailer is sent little endian.
+ */
+class Crc32c {
+ public:
+    enum { kSize = 4 };
+
+    Crc32c() : mCrc(0xffffffff), mFailures(0) {}
+
+    inline void reset() { mCrc = 0xffffffff; }
+    // a byte at a time is the decoder's hot path: one table lookup inline,
+    // instead of a call and the CPU dispatch of crc32c_update().
+    inline void update( uint8_t c ) {
+#ifdef __AVR__
+      mCrc = crc32c_update(mCrc, &c, 1);
+#else
+      mCrc = (mCrc >> 8) ^ kCrc32cTable[(mCrc ^ c) & 0xff];
+#endif
+    }
+    inline void update( const uint8_t *data, int size ) { mCrc = crc32c_update(mCrc, data, size); }
+    inline uint32_t value() const { return ~mCrc; }
+
+    inline void trailer( uint8_t *out ) const {
+      uint32_t v = value();
+      out[0] = v & 0xff;
+      out[1] = (v >> 8) & 0xff;
+      out[2] = (v >> 16) & 0xff;
+      out[3] = v >> 24;
+    }
+    // the register of intact data followed by its trailer.
+    inline bool check() {
+      if (mCrc == 0xb798b438) return true;
+      mFailures++;
+      return false;
+    }
+    inline void fail() { mFailures++; }
+    inline uint32_t failures() const { return mFailures; }
+
+ private:
+    uint32_t mCrc;
+    uint32_t mFailures;
+};
+
+} // end namespace crc
+} // end namespace fou
+
+#endif
@@ -27,8 +27,9 @@
  */
 
 #include "fosc.h"
+#include "fosc_endian.h"
 
-#include <string.h>   // strlen
+#include <string.h>   // strlen, memchr
 
 #ifdef FOU_USE_STD_ARG
 #include <stdarg.h> // provides variable arguments
@@ -43,24 +44,32 @@
 using namespace fou::osc;
 
 /*
- *  arduino uses Little Endian byte order whereas OSC uses big endian AKA network byte order/
- *  these functions convert 32 bit data accordingly. 
+ *  OSC uses big endian AKA network byte order. These functions convert 32 
+ *  and 64 bit data between host and network order, see fosc_endian.h.
  */
 
 // Network to Host
-inline void copyNTOHL(char *dst, char *src) {
-  dst[0] = src[3];
-  dst[1] = src[2];
-  dst[2] = src[1];
-  dst[3] = src[0];
+inline void copyNTOHL(char *dst, const char *src) {
+  uint32_t v = endian::load32((const uint8_t *)src);
+  memcpy(dst, &v, 4);
 }
 
 // Host to Network
-inline void copyHTONL(char *dst, char *src) {
-  dst[0] = src[3];
-  dst[1] = src[2];
-  dst[2] = src[1];
-  dst[3] = src[0];
+inline void copyHTONL(char *dst, const char *src) {
+  uint32_t v;
+  memcpy(&v, src, 4);
+  endian::store32((uint8_t *)dst, v);
+}
+
+inline void copyNTOHLL(char *dst, const char *src) {
+  uint64_t v = endian::load64((const uint8_t *)src);
+  memcpy(dst, &v, 8);
+}
+
+inline void copyHTONLL(char *dst, const char *src) {
+  uint64_t v;
+  memcpy(&v, src, 8);
+  endian::store64((uint8_t *)dst, v);
 }
 
 
@@ -75,18 +84,20 @@ inline void copyHTONL(char *dst, char *src) {
  */
 
 
-bool MessageIterator::append_data_and_pad(uint8_t *src, uint32_t size) {
-  // TODO:make a proper size check. %3 is not correct
-  if (capacity_ < (int)size + mesg_size_ + (int)(size%3)) return false;
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::append_data_and_pad(uint8_t *src, uint32_t size) {
+  // the data and its padding.
+  if ((uint32_t)capacity_ < ((mesg_size_ + size + 3) & ~3u)) return false;
   memcpy(&buffer_[mesg_size_],src,size);
   mesg_size_+=size;
   pad();
   return true;
 }
 
-bool MessageIterator::append_string_and_pad(const char *src) {
-  // TODO:make a proper size check. %3 is not correct
-  if (capacity_ < (mesg_size_+(int)strlen(src)+(int)(strlen(src)%3))) return false;
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::append_string_and_pad(const char *src) {
+  // the string, its terminator and the padding.
+  if ((uint32_t)capacity_ < ((mesg_size_ + strlen(src) + 1 + 3) & ~3u)) return false;
   while ( *src != '\0') {
     buffer_[mesg_size_] = *src;
     src++;
@@ -100,7 +111,8 @@ bool MessageIterator::append_string_and_pad(const char *src) {
 
 
 
-TypeTag_t MessageIterator::arg_type() const {
+template <typename Size_t>
+TypeTag_t BasicMessageIterator<Size_t>::arg_type() const {
   if ( arg_types_==NULL) return kFOSC_UNKNOWN;
   // DEBUG("arg types, index :"); 
   // DEBUG(arg_types_);
@@ -110,6 +122,16 @@ TypeTag_t MessageIterator::arg_type() const {
     case 'i':
     case 's':
     case 'b':
+    case 'h':
+    case 't':
+    case 'd':
+    case 'S':
+    case 'c':
+    case 'm':
+    case 'T':
+    case 'F':
+    case 'N':
+    case 'I':
       return (TypeTag_t)arg_types_[args_index_];
       break;
     default:
@@ -119,31 +141,56 @@ TypeTag_t MessageIterator::arg_type() const {
 }
 
 /**
- *  Decode an OSC message.
+ *  Decode an OSC message. The address and the type tags are only read
+ *  within size, the arguments are not checked: validate untrusted packets
+ *  with validateMessage() first.
  *  @param buffer the input buffer.
- *  @param capacity the input buffer capacity.
+ *  @param size the size of the message.
  *  @return true on success. 
  */
-bool MessageIterator::decode(char* buf, int size) {
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::decode(char* buf, int size) {
   // assert(buf!=NULL);
   buffer_ = buf;
   mesg_size_ = 0;
+  arg_types_ = NULL;
+  if (size <= 0) return false;
   // DEBUG("decode:addres: "); DEBUG(buffer_); DEBUG("\n");
   
-  mesg_size_+=strlen(buffer_)+1; // including the '\0' character
-  pad();
-  if (buffer_[mesg_size_] != ',') {
+  // the address and the type tags must be terminated within size.
+  const char *end = (const char *)memchr(buffer_, 0, size);
+  if (end == NULL) return false;
+  int offset = ((end - buffer_) + 4) & ~3; // including the '\0' character and padding
+  if (offset >= size || buffer_[offset] != ',') {
     // DEBUG("fosc error: Ignoring incoming message. No typetag string\n");
     return false;
   }
-  mesg_size_++;
+  offset++;
+  end = (const char *)memchr(buffer_ + offset, 0, size - offset);
+  if (end == NULL) return false;
   args_index_=0;
-  arg_types_ = &buffer_[mesg_size_];
+  arg_types_ = &buffer_[offset];
   // DEBUG("decode:arg_types: "); DEBUG(arg_types_); DEBUG("\n");
   
-  arg_types_size_ = strlen(&buffer_[mesg_size_]);
-  mesg_size_+=arg_types_size_+1;
-  pad();
+  arg_types_size_ = end - arg_types_;
+  mesg_size_ = ((end - buffer_) + 4) & ~3;
+  return true;
+}
+
+/**
+ *  Decode an OSC message that has already been parsed, for instance by
+ *  slip::MessageDecoder. Nothing is scanned again.
+ *  @param buffer the input buffer.
+ *  @param layout the offsets of the message in the buffer.
+ *  @return true on success. 
+ */
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::decode(char* buf, const MessageLayout_t &layout) {
+  buffer_ = buf;
+  arg_types_ = &buffer_[layout.types];
+  arg_types_size_ = layout.types_size;
+  args_index_ = 0;
+  mesg_size_ = layout.args;
   return true;
 }
 
@@ -153,8 +200,9 @@ bool MessageIterator::decode(char* buf, int size) {
  *  @return true on success.
  *  @see decode()
  */  
-bool MessageIterator::i(int32_t &i) {
-  copyHTONL((char*)&i,&buffer_[mesg_size_]);
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::i(int32_t &i) {
+  copyNTOHL((char*)&i,&buffer_[mesg_size_]);
   args_index_++;
   mesg_size_+=4;
   return true;
@@ -166,8 +214,9 @@ bool MessageIterator::i(int32_t &i) {
  *  @return true on success.
  *  @see decode()
  */    
-bool MessageIterator::f(float &f) {
-  copyHTONL((char*)&f,&buffer_[mesg_size_]);
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::f(float &f) {
+  copyNTOHL((char*)&f,&buffer_[mesg_size_]);
   args_index_++;
   mesg_size_+=4;
   return true;
@@ -179,8 +228,9 @@ bool MessageIterator::f(float &f) {
  *  @return the size of the string.
  *  @see decode()
  */    
-int MessageIterator::s(char **s) {
-  // TODO: restrain size
+template <typename Size_t>
+int BasicMessageIterator<Size_t>::s(char **s) {
+  // unbounded, validate untrusted packets with validateMessage() first.
   *s = &buffer_[mesg_size_];
   // DEBUG("string....."); DEBUG(&buffer_[mesg_size_]);
   int len = strlen(&buffer_[mesg_size_]);
@@ -197,16 +247,138 @@ int MessageIterator::s(char **s) {
  *  @return true on success.
  *  @see decode()
  */    
-int32_t MessageIterator::b(uint8_t *data) {
+template <typename Size_t>
+int32_t BasicMessageIterator<Size_t>::b(uint8_t *data) {
   // copy the blob
   int32_t size;
-  copyHTONL((char *)&size,&buffer_[mesg_size_]);	// append size
-  mesg_size_+=4+size;
+  copyNTOHL((char *)&size,&buffer_[mesg_size_]);	// blob size
+  mesg_size_+=4+((size+3)&~3); // blob data is padded
   // TODO foscAppendDataAndPad(&(args_), blob->size, blob->data);
   args_index_++;
   return size;
 }
 
+/**
+ *  Retrieve a 64 bit int. Use when decoding a message, order does matter.
+ *  @param h the int.
+ *  @return true on success.
+ *  @see decode()
+ */  
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::h(int64_t &h) {
+  copyNTOHLL((char*)&h,&buffer_[mesg_size_]);
+  args_index_++;
+  mesg_size_+=8;
+  return true;
+}
+
+/**
+ *  Retrieve a time tag. Use when decoding a message, order does matter.
+ *  @param t the time tag.
+ *  @return true on success.
+ *  @see decode()
+ */  
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::t(TimeTag_t &t) {
+  endian::load((const uint8_t *)&buffer_[mesg_size_], t);
+  args_index_++;
+  mesg_size_+=8;
+  return true;
+}
+
+/**
+ *  Retrieve a double. Use when decoding a message, order does matter.
+ *  @param d the double.
+ *  @return true on success.
+ *  @see decode()
+ */  
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::d(double &d) {
+  endian::load((const uint8_t *)&buffer_[mesg_size_], d);
+  args_index_++;
+  mesg_size_+=8;
+  return true;
+}
+
+/**
+ *  Retrieve a symbol. Symbols are encoded as strings.
+ *  @param s a pointer to the symbol. 
+ *  @return the size of the symbol.
+ *  @see s()
+ */    
+template <typename Size_t>
+int BasicMessageIterator<Size_t>::S(char **s) {
+  return this->s(s);
+}
+
+/**
+ *  Retrieve a char, sent as 32 bits. Use when decoding a message.
+ *  @param c the char.
+ *  @return true on success.
+ *  @see decode()
+ */  
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::c(char &c) {
+  c = buffer_[mesg_size_+3];
+  args_index_++;
+  mesg_size_+=4;
+  return true;
+}
+
+/**
+ *  Retrieve a MIDI message: port id, status byte, data1, data2.
+ *  @param midi 4 bytes.
+ *  @return true on success.
+ *  @see decode()
+ */  
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::m(uint8_t *midi) {
+  memcpy(midi,&buffer_[mesg_size_],4);
+  args_index_++;
+  mesg_size_+=4;
+  return true;
+}
+
+/**
+ *  Skip the current argument, whatever its type. T, F, N and I carry no
+ *  data, their value is the type itself: check arg_type() and skip().
+ *  @return false for an unknown type, which cannot be skipped.
+ *  @see arg_type()
+ */  
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::skip() {
+  char *str;
+  switch (arg_type()) {
+    case kFOSC_INT32:
+    case kFOSC_FLOAT:
+    case kFOSC_CHAR:
+    case kFOSC_MIDI:
+      mesg_size_+=4;
+      break;
+    case kFOSC_INT64:
+    case kFOSC_TIMETAG:
+    case kFOSC_DOUBLE:
+      mesg_size_+=8;
+      break;
+    case kFOSC_STRING:
+    case kFOSC_SYMBOL:
+      s(&str);
+      return true;
+    case kFOSC_BLOB:
+      b(NULL);
+      return true;
+    case kFOSC_TRUE:
+    case kFOSC_FALSE:
+    case kFOSC_NIL:
+    case kFOSC_INFINITUM:
+      break;
+    default:
+      return false;
+  }
+  args_index_++;
+  return true;
+}
+
 /**
  *  Encode an OSC message.
  *  @param buffer the output buffer.
@@ -216,17 +388,22 @@ int32_t MessageIterator::b(uint8_t *data) {
  *  @return true on success. 
  *  @see encode()
  */
-bool MessageIterator::encode(char* out_buffer, int capacity, const char *addr, const char *typetags) {
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::encode(char* out_buffer, int capacity, const char *addr, const char *typetags) {
   // assert(out_buffer!=NULL);
   // assert( *addr == '/'); // is it a message ?
   capacity_ = capacity;
   mesg_size_ = 0;
   buffer_ = out_buffer;
   args_index_ = 0;
-  append_string_and_pad(addr);// insert address
+  arg_types_ = NULL;
+  if (!append_string_and_pad(addr)) return false; // insert address
+  if (mesg_size_ >= capacity_) return false;
   buffer_[mesg_size_] = ',';
   mesg_size_++; // add , to begin type tag string
-  append_string_and_pad(typetags);
+  arg_types_ = &buffer_[mesg_size_];
+  arg_types_size_ = strlen(typetags);
+  if (!append_string_and_pad(typetags)) return false;
   args_ = out_buffer+mesg_size_;
   return true;
 }
@@ -238,8 +415,10 @@ bool MessageIterator::encode(char* out_buffer, int capacity, const char *addr, c
  *  @param i the int.
  *  @return true on success.
  */
-bool MessageIterator::append_i(int32_t i) {
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::append_i(int32_t i) {
   // DEBUG("append: "); DEBUG(i); DEBUG("\n");
+  if (!room(4)) return false;
   copyHTONL(&buffer_[mesg_size_],(char*)&i);
   args_index_++;
   mesg_size_+=4;
@@ -252,7 +431,9 @@ bool MessageIterator::append_i(int32_t i) {
  *  @return true on success.
  *  @see encode()
  */  
-bool MessageIterator::append_f(float f) {
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::append_f(float f) {
+  if (!room(4)) return false;
   copyHTONL(&buffer_[mesg_size_],(char*)&f);
   args_index_++;
   mesg_size_+=4;
@@ -265,9 +446,10 @@ bool MessageIterator::append_f(float f) {
  *  @return true on success.
  *  @see encode()
  */  
-bool MessageIterator::append_s(const char *s) {
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::append_s(const char *s) {
   // DEBUG("append "); DEBUG(s); DEBUG("\n");
-  append_string_and_pad(s);
+  if (!append_string_and_pad(s)) return false;
   args_index_++;
   return true;
 }
@@ -279,34 +461,151 @@ bool MessageIterator::append_s(const char *s) {
  *  @return true on success.
  *  @see encode()
  */  
-bool MessageIterator::append_b(uint8_t *data, int32_t size) {
-  // copy the blob TODO:capicity check....
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::append_b(uint8_t *data, int32_t size) {
+  if (size < 0 || !room(4+((size+3)&~3))) return false;
   copyHTONL(&buffer_[mesg_size_],(char *)&(size));	// append size
   mesg_size_+=4;
   memcpy(&buffer_[mesg_size_],data,size);
   mesg_size_+=(int)size;
+  pad();
   // TODO foscAppendDataAndPad(&(args_), blob->size, blob->data);
   args_index_++;
   return true;
 }
 
+/**
+ *  Append a 64 bit int. Use when encoding a message, order does matter.
+ *  @param h the int.
+ *  @return true on success.
+ *  @see encode()
+ */  
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::append_h(int64_t h) {
+  if (!room(8)) return false;
+  copyHTONLL(&buffer_[mesg_size_],(char*)&h);
+  args_index_++;
+  mesg_size_+=8;
+  return true;
+}
+
+/**
+ *  Append a time tag. Use when encoding a message, order does matter.
+ *  @param t the time tag.
+ *  @return true on success.
+ *  @see encode()
+ */  
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::append_t(const TimeTag_t &t) {
+  if (!room(8)) return false;
+  endian::store((uint8_t *)&buffer_[mesg_size_], t);
+  args_index_++;
+  mesg_size_+=8;
+  return true;
+}
+
+/**
+ *  Append a double. Use when encoding a message, order does matter.
+ *  @param d the double.
+ *  @return true on success.
+ *  @see encode()
+ */  
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::append_d(double d) {
+  if (!room(8)) return false;
+  endian::store((uint8_t *)&buffer_[mesg_size_], d);
+  args_index_++;
+  mesg_size_+=8;
+  return true;
+}
+
+/**
+ *  Append a symbol. Symbols are encoded as strings.
+ *  @param s the symbol.
+ *  @return true on success.
+ *  @see append_s()
+ */  
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::append_S(const char *s) {
+  return append_s(s);
+}
+
+/**
+ *  Append a char, sent as 32 bits. Use when encoding a message.
+ *  @param c the char.
+ *  @return true on success.
+ *  @see encode()
+ */  
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::append_c(char c) {
+  return append_i((int32_t)(uint8_t)c);
+}
+
+/**
+ *  Append a MIDI message: port id, status byte, data1, data2.
+ *  @param midi 4 bytes.
+ *  @return true on success.
+ *  @see encode()
+ */  
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::append_m(const uint8_t *midi) {
+  if (!room(4)) return false;
+  memcpy(&buffer_[mesg_size_],midi,4);
+  args_index_++;
+  mesg_size_+=4;
+  return true;
+}
+
+/**
+ *  Account for an argument that has no data, its type tag is its value.
+ */  
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::append_tag_only(char tag) {
+  if (arg_types_ == NULL || arg_types_[args_index_] != tag) return false;
+  args_index_++;
+  return true;
+}
+
+/**
+ *  Append True, False, Nil or Infinitum. These carry no data, but keep the
+ *  arguments in step with the type tag string.
+ *  @return true when the type tag string has the tag at this position.
+ */  
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::append_T() { return append_tag_only('T'); }
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::append_F() { return append_tag_only('F'); }
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::append_N() { return append_tag_only('N'); }
+template <typename Size_t>
+bool BasicMessageIterator<Size_t>::append_I() { return append_tag_only('I'); }
+
+
+
+// the message iterator is compiled once for every index type IndexFor<> can select.
+template class fou::osc::BasicMessageIterator<int>;
+template class fou::osc::BasicMessageIterator<uint8_t>;
+template class fou::osc::BasicMessageIterator<uint16_t>;
+template class fou::osc::BasicMessageIterator<uint32_t>;
 
 
 /***-------------------- BUNDLE ITERATOR ----------------------------------***/
 
 // TODO:this is a copy of the message iterator.
-bool BundleIterator::append_data_and_pad(uint8_t *src, uint32_t size) {
-  // TODO:make a proper size check. %3 is not correct
-  if (capacity_ < (int)size + size_ + (int)(size%3)) return false;
+template <typename Size_t>
+bool BasicBundleIterator<Size_t>::append_data_and_pad(uint8_t *src, uint32_t size) {
+  // the data and its padding.
+  if ((uint32_t)capacity_ < ((size_ + size + 3) & ~3u)) return false;
   memcpy(&buffer_[size_],src,size);
   size_+=size;
   pad();
   return true;
 }
 // TODO:this is a copy of the message iterator.
-bool BundleIterator::append_string_and_pad(const char *src) {
-  // TODO:make a proper size check. %3 is not correct
-  if (capacity_ < (size_+(int)strlen(src)+(int)(strlen(src)%3))) return false;
+template <typename Size_t>
+bool BasicBundleIterator<Size_t>::append_string_and_pad(const char *src) {
+  // the string, its terminator and the padding.
+  if ((uint32_t)capacity_ < ((size_ + strlen(src) + 1 + 3) & ~3u)) return false;
   while ( *src != '\0') {
     buffer_[size_] = *src;
     src++;
@@ -324,7 +623,8 @@ bool BundleIterator::append_string_and_pad(const char *src) {
  *  @param sec seconds.
  *  @param frac fraction of a second.
  */  
-void BundleIterator::timetag(int32_t &sec, int32_t &frac) {
+template <typename Size_t>
+void BasicBundleIterator<Size_t>::timetag(int32_t &sec, int32_t &frac) {
   copyNTOHL((char*)&sec,buffer_+8);
   copyNTOHL((char*)&frac,buffer_+12);
 }
@@ -333,7 +633,8 @@ void BundleIterator::timetag(int32_t &sec, int32_t &frac) {
  *  @param sec seconds.
  *  @param frac fraction of a second.
  */  
-void BundleIterator::set_timetag(int32_t sec, int32_t frac) {
+template <typename Size_t>
+void BasicBundleIterator<Size_t>::set_timetag(int32_t sec, int32_t frac) {
   copyHTONL(buffer_+8,(char*)&sec);
   copyHTONL(buffer_+12,(char*)&frac);
 }
@@ -343,7 +644,8 @@ void BundleIterator::set_timetag(int32_t sec, int32_t frac) {
  *  @param buffer the output buffer.
  *  @param capacity the output buffer capacity.
  */
-bool BundleIterator::encode(char* buffer, int capacity) {
+template <typename Size_t>
+bool BasicBundleIterator<Size_t>::encode(char* buffer, int capacity) {
   // TODO: assert alignment
   
   if (capacity < 16) return false;
@@ -362,21 +664,25 @@ bool BundleIterator::encode(char* buffer, int capacity) {
  *  @param type_tag is the string with arguments.
  *  @return message Iterator.
  */
-bool BundleIterator::begin_message(MessageIterator &mi, char *address, char *typetags) {
+template <typename Size_t>
+bool BasicBundleIterator<Size_t>::begin_message(MessageIterator &mi, const char *address, const char *typetags) {
 	// skip over the size and insert it later
-  return mi.encode(buffer_+size_+4,capacity_-size_,address, typetags);
+  if (capacity_ - size_ < 4) return false;
+  return mi.encode(buffer_+size_+4,capacity_-size_-4,address, typetags);
 }
 
 /**
  *  End a message within OSC bundle.
  *  @param message the message iterator
  */
-void  BundleIterator::end_message(const MessageIterator &mi) {
-  // insert the size of the message and append the message.
+template <typename Size_t>
+void BasicBundleIterator<Size_t>::end_message(const MessageIterator &mi) {
+  // insert the size of the message and append the message. The size 
+  // counts the message only, not the size field itself.
 	uint32_t size;
-	size = mi.size() +4;
+	size = mi.size();
   copyHTONL((buffer_+size_),(char *)&size); // size
-	size_ += size;
+	size_ += 4 + size;
 }
 #ifdef FOU_USE_STD_ARG
 // bool add_message(char *addr, char *typetags, ...);
@@ -386,21 +692,24 @@ void  BundleIterator::end_message(const MessageIterator &mi) {
  *  Begin a bundle within OSC bundle.
  *  @return bundle Iterator.
  */
-bool BundleIterator::begin_bundle(BundleIterator &bi) {
-  return bi.encode(buffer_+4, capacity_ - size_);
+template <typename Size_t>
+bool BasicBundleIterator<Size_t>::begin_bundle(BasicBundleIterator &bi) {
+	// skip over the size and insert it later
+  if (capacity_ - size_ < 4) return false;
+  return bi.encode(buffer_+size_+4, capacity_-size_-4);
 }
 
 /**
  *  End a bundle within OSC bundle.
  *  @param bundle the bundle.
  */
-void BundleIterator::end_bundle(BundleIterator &bi) {
+template <typename Size_t>
+void BasicBundleIterator<Size_t>::end_bundle(BasicBundleIterator &bi) {
   // insert the size of the message and append the bundle.
 	uint32_t size;
-	size = bi.size() +4;
+	size = bi.size();
   copyHTONL((buffer_+size_),(char *)&size); // size
-	size_ += size;
-  
+	size_ += 4 + size;
 }
 
 /**
@@ -408,10 +717,12 @@ void BundleIterator::end_bundle(BundleIterator &bi) {
  *  @param buffer the output buffer.
  *  @param size the output buffer size.
  */
-bool BundleIterator::decode(char* buffer, int size) {
+template <typename Size_t>
+bool BasicBundleIterator<Size_t>::decode(char* buffer, int size) {
   if (size < 16) return false;
   buffer_ = buffer;
   capacity_ = size;
+  size_ = size;
   element_ = buffer+16;
   return true;
 }
@@ -420,34 +731,56 @@ bool BundleIterator::decode(char* buffer, int size) {
  *  Retrieve an encapsulated message when decoding a bundle. The message 
  *  iterator is initialized for decoding.
  *  @param mi the message iterator
- *  @return true on succes, false on error.
+ *  @return true on succes, false on error or when the next element is not 
+ *  a message.
  */
-bool BundleIterator::element(MessageIterator &mi) {
-  if (element_is_bundle()) return false;
-  uint32_t size = 0;
-  
-  return mi.decode(element_+4, size-4); // TODO HTON??????
+template <typename Size_t>
+bool BasicBundleIterator<Size_t>::element(MessageIterator &mi) {
+  if (!element_is_message()) return false;
+  char *data;
+  int size;
+  if (!element(&data, size)) return false;
+  return mi.decode(data, size);
 }
 
 /**
  *  Retrieve an encapsulated bundle when decoding a bundle. The bundle 
  *  iterator is initialized for decoding.
  *  @param bi the bundle iterator
- *  @return true on succes, false on error.
+ *  @return true on succes, false on error or when the next element is not 
+ *  a bundle.
  */
-bool BundleIterator::element(BundleIterator &bi) {
-  if (element_is_message()) return false;
-  uint32_t size=0;
-  return bi.decode(element_+4, size-4); // TODO HTON??????
+template <typename Size_t>
+bool BasicBundleIterator<Size_t>::element(BasicBundleIterator &bi) {
+  if (!element_is_bundle()) return false;
+  char *data;
+  int size;
+  if (!element(&data, size)) return false;
+  return bi.decode(data, size);
 }
 
-bool BundleIterator::element(char **buffer, int &size) {
-  // uint32_t s;
-  // TODO::implement
-  return false;
+/**
+ *  Retrieve the next element, of any type, when decoding a bundle.
+ *  @param buffer set to the first byte of the element.
+ *  @param size set to the size of the element.
+ *  @return false when there are no more elements, or the size of the next 
+ *  one runs past the bundle.
+ */
+template <typename Size_t>
+bool BasicBundleIterator<Size_t>::element(char **buffer, int &size) {
+  if (element_ == NULL) return false;
+  int left = (int)(buffer_ + size_ - element_) - 4;
+  if (left < 0) return false;
+  uint32_t n = endian::load32((const uint8_t *)element_);
+  if (n > (uint32_t)left) return false;
+  *buffer = element_ + 4;
+  size = (int)n;
+  element_ += 4 + n;
+  return true;
 }
 
-
-
-
-
+// the bundle iterator is compiled once for every index type IndexFor<> can select.
+template class fou::osc::BasicBundleIterator<int>;
+template class fou::osc::BasicBundleIterator<uint8_t>;
+template class fou::osc::BasicBundleIterator<uint16_t>;
+template class fou::osc::BasicBundleIterator<uint32_t>;
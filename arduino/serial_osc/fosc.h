@@ -32,6 +32,8 @@
 #include "stdint.h"
 #include "stddef.h"
 
+#include "capacity.h"
+
 namespace fou {
 namespace osc {
 
@@ -51,6 +53,22 @@ typedef struct {
 	uint32_t frac;
 } TimeTag_t;
 
+#ifndef FOSC_MAX_ARGS
+#define FOSC_MAX_ARGS 16 /** arguments tracked by a MessageLayout_t */
+#endif
+
+/**
+ *  Offsets into an OSC message, relative to its first byte, as found by a 
+ *  parser that has already walked the message.
+ */
+typedef struct {
+	uint16_t types;       /** first tag, after the ',' */
+	uint16_t types_size;  /** number of tags */
+	uint16_t args;        /** first argument */
+	uint16_t size;        /** total size of the message */
+	uint16_t arg[FOSC_MAX_ARGS]; /** offset of every argument */
+} MessageLayout_t;
+
 typedef enum {
 	/* TODO: internal OSC types */	
 	kFOSC_DONE =	0, 	/** iterator : no more tags in the string */
@@ -81,14 +99,19 @@ typedef enum {
  *  and decodes OSC messages to and from a buffer. The Message Iterator makes
  *  use of external buffers (such as lwIP pbuf. It simply provides a friendly
  *  interface to read and write from those buffers. 
+ *
+ *  Size_t is the type used for sizes and indices into the buffer. Use
+ *  MessageIterator for buffers sized at runtime and StaticMessage for a
+ *  message that owns a buffer of compile time size.
  */
-class MessageIterator {
+template <typename Size_t>
+class BasicMessageIterator {
   
 public:
   /**
    *  Constructor.
    */
-  MessageIterator() : 
+  BasicMessageIterator() : 
   buffer_(NULL), arg_types_(NULL), args_(NULL), arg_types_size_(0), mesg_size_(0) {};
   
 
@@ -112,13 +135,33 @@ public:
   bool append_f(float f);
   bool append_s(const char *s);
   bool append_b(uint8_t *data, int32_t size);
+  // extended OSC types
+  bool append_h(int64_t h);
+  bool append_t(const TimeTag_t &t);
+  bool append_d(double d);
+  bool append_S(const char *s);
+  bool append_c(char c);
+  bool append_m(const uint8_t *midi);
+  bool append_T();
+  bool append_F();
+  bool append_N();
+  bool append_I();
   
   
   bool decode(char* buf, int size);
+  bool decode(char* buf, const MessageLayout_t &layout);
   bool i(int32_t &i);
   bool f(float &f);
   int s(char** s);
   int32_t b(uint8_t* data);
+  // extended OSC types
+  bool h(int64_t &h);
+  bool t(TimeTag_t &t);
+  bool d(double &d);
+  int S(char** s);
+  bool c(char &c);
+  bool m(uint8_t *midi);
+  bool skip();
   
   /**
    *  Get the address string.
@@ -155,54 +198,71 @@ private:
     }
   };
   
+  inline bool room(int size) const { return mesg_size_ + size <= capacity_; };
+  bool append_tag_only(char tag);
+  
   bool append_data_and_pad(uint8_t *src, uint32_t size);
   bool append_string_and_pad(const char *src);
   char *buffer_; // pointer to the start of the message
   char *arg_types_; // pointer to the start of the argument types 
   char *args_;	// a convenience pointer to iterate through the arguments 	
-  int arg_types_size_;
-  int capacity_;            
-  int mesg_size_;	// length of the total message 
-  int args_index_;
+  Size_t arg_types_size_;
+  Size_t capacity_;            
+  Size_t mesg_size_;	// length of the total message 
+  Size_t args_index_;
 };
 
-class BundleIterator {
+typedef BasicMessageIterator<int> MessageIterator;
+
+
+/**
+ *  An Open Sound Control bundle iterator. Encodes a bundle element by 
+ *  element, or walks the elements of a received bundle with element().
+ *
+ *  Size_t is the type used for sizes and indices into the buffer, as for
+ *  BasicMessageIterator. Use BundleIterator for buffers sized at runtime and
+ *  StaticBundle for a bundle that owns a buffer of compile time size.
+ */
+template <typename Size_t>
+class BasicBundleIterator {
   
 public:
-  BundleIterator() : buffer_(0), capacity_(0), size_(0) {};
+  BasicBundleIterator() : buffer_(0), element_(0), capacity_(0), size_(0) {};
   
-  inline ElementType_t element_type() {
-    if (buffer_[size_] == '/') return kFOSC_MESSAGE;
-    if (buffer_[size_] == '#') return kFOSC_BUNDLE;
+  /**
+   *  The type of the next element, when decoding.
+   */
+  inline ElementType_t element_type() const {
+    if (element_ == NULL || buffer_ + size_ - element_ <= 4) return kFOSC_UNKOWN_ELEMENT;
+    if (element_[4] == '/') return kFOSC_MESSAGE;
+    if (element_[4] == '#') return kFOSC_BUNDLE;
     return kFOSC_UNKOWN_ELEMENT;
   };
-  inline bool element_is_bundle() {
-    if (buffer_[size_] == '#') return true;
-    return false;
+  inline bool element_is_bundle() const {
+    return element_type() == kFOSC_BUNDLE;
   }
-  inline bool element_is_message() {
-    if (buffer_[size_] == '/') return true;
-    return false;
+  inline bool element_is_message() const {
+    return element_type() == kFOSC_MESSAGE;
   }
   
   void timetag(int32_t &sec, int32_t &frac);
   void set_timetag(int32_t sec, int32_t frac);
-  inline int size() { return size_; };
+  inline int size() const { return size_; };
   
   bool encode(char* buffer, int capacity);
-  bool begin_message(MessageIterator &mi, char *address, char *typetags);
+  bool begin_message(MessageIterator &mi, const char *address, const char *typetags);
   void end_message(const MessageIterator &mi);
 #ifdef FOU_USE_STD_ARG  
   // bool add_message(char *addr, char *typetags, ...);
 #endif
   
-  bool begin_bundle(BundleIterator &bundle);
-  void end_bundle(BundleIterator &bundle);
+  bool begin_bundle(BasicBundleIterator &bundle);
+  void end_bundle(BasicBundleIterator &bundle);
   
   
   bool decode(char* buffer, int size);
   bool element(MessageIterator &mi);
-  bool element(BundleIterator &bi);
+  bool element(BasicBundleIterator &bi);
   bool element(char **buffer, int &size);
   
   bool append_data_and_pad(uint8_t *src, uint32_t size);
@@ -210,9 +270,9 @@ public:
   
 private:
   char *buffer_;
-  char *element_;
-  int capacity_;              
-  int size_; 
+  char *element_; // size field of the next element, when decoding
+  Size_t capacity_;              
+  Size_t size_; 
   
   // TODO: copy of message iterator.
   inline void pad() {
@@ -223,6 +283,81 @@ private:
   };
 };
 
+typedef BasicBundleIterator<int> BundleIterator;
+
+/**
+ *  An OSC message that owns a buffer of Capacity bytes. Sizes and indices use
+ *  the smallest type that fits the capacity, so small messages cost little RAM
+ *  on 8 bit targets.
+ */
+template <uint32_t Capacity>
+class StaticMessage : public BasicMessageIterator<typename IndexFor<Capacity>::type> {
+  typedef BasicMessageIterator<typename IndexFor<Capacity>::type> Base;
+public:
+  // the smallest message is "/\0\0\0,\0\0\0", and OSC data is 4 byte aligned.
+  static_assert(Capacity >= 8, "fosc::StaticMessage is too small for any message");
+  static_assert((Capacity & 3) == 0, "fosc::StaticMessage capacity must be a multiple of 4");
+
+  StaticMessage() {}
+
+  /**
+   *  Encode an OSC message into the owned buffer.
+   *  @param addr is the OSC address.
+   *  @param typetags is the string with arguments.
+   *  @return true on success. 
+   */
+  inline bool encode(const char *addr, const char *typetags) {
+    return Base::encode(storage_, Capacity, addr, typetags);
+  }
+  /**
+   *  Decode the OSC message that has been written into data().
+   *  @param size the number of valid bytes.
+   *  @return true on success. 
+   */
+  inline bool decode(int size) {
+    if (size < 0 || (uint32_t)size > Capacity) return false;
+    return Base::decode(storage_, size);
+  }
+  inline char *data() { return storage_; }
+  inline static uint32_t capacity() { return Capacity; }
+
+private:
+  // the iterator points into storage_, a copy would point into the original.
+  StaticMessage(const StaticMessage &);
+  StaticMessage &operator=(const StaticMessage &);
+
+  char storage_[Capacity];
+};
+
+/**
+ *  An OSC bundle that owns a buffer of Capacity bytes. Sizes and indices use
+ *  the smallest type that fits the capacity.
+ */
+template <uint32_t Capacity>
+class StaticBundle : public BasicBundleIterator<typename IndexFor<Capacity>::type> {
+  typedef BasicBundleIterator<typename IndexFor<Capacity>::type> Base;
+public:
+  // "#bundle\0" and the time tag.
+  static_assert(Capacity >= 16, "fosc::StaticBundle is too small for a bundle header");
+  static_assert((Capacity & 3) == 0, "fosc::StaticBundle capacity must be a multiple of 4");
+
+  StaticBundle() {}
+
+  inline bool encode() { return Base::encode(storage_, Capacity); }
+  inline bool decode(int size) {
+    if (size < 0 || (uint32_t)size > Capacity) return false;
+    return Base::decode(storage_, size);
+  }
+  inline char *data() { return storage_; }
+  inline static uint32_t capacity() { return Capacity; }
+
+private:
+  StaticBundle(const StaticBundle &);
+  StaticBundle &operator=(const StaticBundle &);
+
+  char storage_[Capacity];
+};
+
 } } // end namespace fou / osc
 
 
@@ -0,0 +1,172 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#ifndef FOSC_ENDIAN_H_
+#define FOSC_ENDIAN_H_
+
+#include "stdint.h"
+#include "string.h" // memcpy
+
+#include "fosc.h" // TimeTag_t
+
+namespace fou {
+namespace osc {
+
+/*
+ *  Host byte order, detected at compile time. OSC uses big endian, AKA
+ *  network byte order. Define FOSC_BIG_ENDIAN or FOSC_LITTLE_ENDIAN for 
+ *  compilers that do not tell.
+ */
+#if !defined(FOSC_BIG_ENDIAN) && !defined(FOSC_LITTLE_ENDIAN)
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define FOSC_BIG_ENDIAN 1
+#else
+#define FOSC_LITTLE_ENDIAN 1
+#endif
+#endif
+
+/*
+ *  Loads and stores of OSC (big endian) values from and to unaligned buffers.
+ *  On 32 and 64 bit hosts a value is copied as a whole and swapped with the
+ *  compiler's byteswap builtin, which becomes a single instruction. 8 bit 
+ *  targets gain nothing from that and copy byte by byte.
+ */
+namespace endian {
+
+#if defined(FOSC_BIG_ENDIAN)
+
+inline uint32_t load32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+inline uint64_t load64(const uint8_t *p) { uint64_t v; memcpy(&v, p, 8); return v; }
+inline void store32(uint8_t *p, uint32_t v) { memcpy(p, &v, 4); }
+inline void store64(uint8_t *p, uint64_t v) { memcpy(p, &v, 8); }
+
+#elif (defined(__GNUC__) || defined(__clang__)) && !defined(__AVR__)
+
+inline uint32_t load32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return __builtin_bswap32(v); }
+inline uint64_t load64(const uint8_t *p) { uint64_t v; memcpy(&v, p, 8); return __builtin_bswap64(v); }
+inline void store32(uint8_t *p, uint32_t v) { v = __builtin_bswap32(v); memcpy(p, &v, 4); }
+inline void store64(uint8_t *p, uint64_t v) { v = __builtin_bswap64(v); memcpy(p, &v, 8); }
+
+#else
+
+inline uint32_t load32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+inline uint64_t load64(const uint8_t *p) {
+  return ((uint64_t)load32(p) << 32) | load32(p + 4);
+}
+inline void store32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+inline void store64(uint8_t *p, uint64_t v) {
+  store32(p, (uint32_t)(v >> 32));
+  store32(p + 4, (uint32_t)v);
+}
+
+#endif
+
+inline void load(const uint8_t *p, int32_t &v) { v = (int32_t)load32(p); }
+inline void load(const uint8_t *p, int64_t &v) { v = (int64_t)load64(p); }
+inline void load(const uint8_t *p, float &v) {
+  uint32_t u = load32(p);
+  memcpy(&v, &u, 4);
+}
+#if defined(__SIZEOF_DOUBLE__) && __SIZEOF_DOUBLE__ == 4
+
+/*
+ *  double is a 32 bit float on AVR, OSC doubles are 64 bit IEEE-754. 
+ *  Convert the bit patterns, denormals flush to zero.
+ */
+inline uint64_t double_bits(double d) {
+  uint32_t f;
+  memcpy(&f, &d, 4);
+  uint64_t sign = (uint64_t)(f >> 31) << 63;
+  uint32_t exp = (f >> 23) & 0xff;
+  uint64_t mant = (uint64_t)(f & 0x7fffff) << 29;
+  if (exp == 0) return sign;
+  if (exp == 0xff) return sign | (0x7ffull << 52) | mant;
+  return sign | ((uint64_t)(exp - 127 + 1023) << 52) | mant;
+}
+
+inline double bits_double(uint64_t u) {
+  uint32_t sign = (uint32_t)(u >> 63) << 31;
+  int exp = (int)((u >> 52) & 0x7ff);
+  uint32_t mant = (uint32_t)((u >> 29) & 0x7fffff);
+  uint32_t f;
+  if (exp == 0x7ff) f = sign | (0xffUL << 23) | mant | (mant == 0 && (u & 0xfffffffffffffull) ? 1 : 0);
+  else if (exp - 1023 + 127 >= 0xff) f = sign | (0xffUL << 23);  // too large, infinity
+  else if (exp - 1023 + 127 <= 0) f = sign;                      // too small, zero
+  else f = sign | ((uint32_t)(exp - 1023 + 127) << 23) | mant;
+  double d;
+  memcpy(&d, &f, 4);
+  return d;
+}
+
+#else
+
+inline uint64_t double_bits(double d) {
+  uint64_t u;
+  memcpy(&u, &d, 8);
+  return u;
+}
+
+inline double bits_double(uint64_t u) {
+  double d;
+  memcpy(&d, &u, 8);
+  return d;
+}
+
+#endif
+
+inline void load(const uint8_t *p, double &v) { v = bits_double(load64(p)); }
+inline void load(const uint8_t *p, TimeTag_t &v) {
+  v.sec = load32(p);
+  v.frac = load32(p + 4);
+}
+
+inline void store(uint8_t *p, int32_t v) { store32(p, (uint32_t)v); }
+inline void store(uint8_t *p, int64_t v) { store64(p, (uint64_t)v); }
+inline void store(uint8_t *p, float v) {
+  uint32_t u;
+  memcpy(&u, &v, 4);
+  store32(p, u);
+}
+inline void store(uint8_t *p, double v) { store64(p, double_bits(v)); }
+inline void store(uint8_t *p, const TimeTag_t &v) {
+  store32(p, v.sec);
+  store32(p + 4, v.frac);
+}
+
+} // end namespace endian
+
+} } // end namespace fou / osc
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#include "fosc_filter.h"
+
+#include <string.h>   // strlen, strncmp, memset
+
+using namespace fou::osc;
+
+static_assert((FOSC_FILTER_SLOTS & (FOSC_FILTER_SLOTS - 1)) == 0,
+              "FOSC_FILTER_SLOTS must be a power of two");
+
+// slots probed for an address before the oldest of them is evicted.
+static const int kProbes = FOSC_FILTER_SLOTS < 4 ? FOSC_FILTER_SLOTS : 4;
+
+AddressFilter::AddressFilter() : rule_count_(0) {
+  reset();
+}
+
+void AddressFilter::reset() {
+  forget();
+  passed_ = 0;
+  dropped_ = 0;
+  overflows_ = 0;
+}
+
+void AddressFilter::forget() {
+  for (int i = 0; i < FOSC_FILTER_SLOTS; i++) slots_[i].rule = -1;
+  memset(misses_, 0, sizeof(misses_));
+}
+
+bool AddressFilter::add(const char *pattern, uint8_t mode, uint32_t interval, uint16_t count) {
+  if (rule_count_ == FOSC_MAX_FILTER_RULES) return false;
+  int len = strlen(pattern);
+  Rule &rule = rules_[rule_count_];
+  rule.prefix = len > 0 && pattern[len - 1] == '*';
+  if (rule.prefix) len--;
+  if (len > 255) return false;
+  rule.pattern = pattern;
+  rule.length = len;
+  rule.mode = mode;
+  rule.interval = interval;
+  rule.count = count;
+  rule_count_++;
+  // addresses seen so far were matched without this rule.
+  forget();
+  return true;
+}
+
+bool AddressFilter::min_interval(const char *pattern, uint32_t interval) {
+  return add(pattern, kMinInterval, interval, 0);
+}
+
+bool AddressFilter::every_nth(const char *pattern, uint16_t n) {
+  return add(pattern, kEveryNth, 0, n > 0 ? n : 1);
+}
+
+bool AddressFilter::window(const char *pattern, uint32_t window, uint16_t count) {
+  return add(pattern, kWindow, window, count);
+}
+
+/**
+ *  @return the first rule that matches, or -1.
+ */
+int AddressFilter::match(const char *address) const {
+  for (int i = 0; i < rule_count_; i++) {
+    const Rule &rule = rules_[i];
+    if (strncmp(address, rule.pattern, rule.length) != 0) continue;
+    if (rule.prefix || address[rule.length] == 0) return i;
+  }
+  return -1;
+}
+
+bool AddressFilter::limit(const Rule &rule, Slot &slot, uint32_t now) {
+  switch (rule.mode) {
+    case kMinInterval:
+      // count marks that a message has passed.
+      if (slot.count != 0 && now - slot.last < rule.interval) return false;
+      slot.count = 1;
+      slot.last = now;
+      return true;
+    case kEveryNth: {
+      bool pass = slot.count == 0;
+      if (++slot.count == rule.count) slot.count = 0;
+      return pass;
+    }
+    case kWindow:
+      if (slot.count == 0 || now - slot.last >= rule.interval) {
+        slot.last = now;
+        slot.count = 0;
+      }
+      if (slot.count >= rule.count) return false;
+      slot.count++;
+      return true;
+  }
+  return true;
+}
+
+bool AddressFilter::accept(const char *buffer, int size, uint32_t now) {
+  // FNV-1a of the address, bounded by the message.
+  uint32_t h = 2166136261UL;
+  int i = 0;
+  while (i < size && buffer[i] != 0) {
+    h = (h ^ (uint8_t)buffer[i]) * 16777619UL;
+    i++;
+  }
+  // no terminator within the message: not a message, and match() would
+  // read past it.
+  if (i >= size) {
+    dropped_++;
+    return false;
+  }
+  if (rule_count_ == 0) {
+    passed_++;
+    return true;
+  }
+
+  // 0 marks an empty entry, an address that hashes to 0 is matched every time.
+  uint32_t &miss = misses_[h & (FOSC_FILTER_SLOTS - 1)];
+  if (h != 0 && miss == h) {
+    passed_++;
+    return true;
+  }
+
+  Slot *victim = NULL;
+  for (int probe = 0; probe < kProbes; probe++) {
+    Slot &slot = slots_[(h + probe) & (FOSC_FILTER_SLOTS - 1)];
+    if (slot.rule < 0) {
+      victim = &slot;
+      break;
+    }
+    if (slot.hash == h) {
+      slot.seen = now;
+      if (limit(rules_[slot.rule], slot, now)) {
+        passed_++;
+        return true;
+      }
+      dropped_++;
+      return false;
+    }
+    if (victim == NULL || now - slot.seen > now - victim->seen) victim = &slot;
+  }
+
+  int rule = match(buffer);
+  if (rule < 0) {
+    miss = h;
+    passed_++;
+    return true;
+  }
+  if (victim->rule >= 0) overflows_++;
+  victim->hash = h;
+  victim->rule = rule;
+  victim->count = 0;
+  victim->last = 0;
+  victim->seen = now;
+  if (limit(rules_[rule], *victim, now)) {
+    passed_++;
+    return true;
+  }
+  dropped_++;
+  return false;
+}
@@ -0,0 +1,143 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#ifndef FOSC_FILTER_H_
+#define FOSC_FILTER_H_
+
+#include "stdint.h"
+
+namespace fou {
+namespace osc {
+
+#ifndef FOSC_MAX_FILTER_RULES
+#define FOSC_MAX_FILTER_RULES 4 /** rules an AddressFilter holds */
+#endif
+
+#ifndef FOSC_FILTER_SLOTS
+#define FOSC_FILTER_SLOTS 16 /** addresses an AddressFilter tracks, a power of two */
+#endif
+
+/**
+ *  Drops messages of high rate addresses before their arguments are decoded.
+ *  A rule matches an exact address, or every address that starts with a
+ *  prefix when the pattern ends in '*'. Every address a rule matches is 
+ *  limited on its own:
+ *
+ *  - min_interval() passes a message when the previous one that passed is
+ *    at least interval ago.
+ *  - every_nth() passes the first message and every n-th after it.
+ *  - window() passes at most count messages in every window.
+ *
+ *  Only addresses a rule matches take a slot in an open addressing table
+ *  keyed by a hash of the address, probed a few slots deep. Addresses no
+ *  rule matches are remembered in a small cache of hashes that is simply
+ *  overwritten, so they never use up the table. The rules are matched when
+ *  an address is not found in either, so a dropped message costs the hash
+ *  and a probe. Two addresses with the same hash share their state. When
+ *  the probed slots are all taken, the least recently seen address gives up
+ *  its slot and its state, counted in overflows().
+ *
+ *  Time is supplied by the caller in any unit, e.g. millis(), and may wrap.
+ *
+ *    AddressFilter filter;
+ *    filter.min_interval("/imu*", 16);    // ~60 Hz with millis()
+ *    if (filter.accept(buf, size, millis())) {
+ *      mi.decode(buf, size);
+ *      ...
+ *    }
+ */
+class AddressFilter {
+public:
+  AddressFilter();
+
+  /**
+   *  Add a rule. The pattern is not copied and must stay valid.
+   *  @return false when there is no room for another rule.
+   */
+  bool min_interval(const char *pattern, uint32_t interval);
+  bool every_nth(const char *pattern, uint16_t n);
+  bool window(const char *pattern, uint32_t window, uint16_t count);
+
+  /**
+   *  Decide on a message, reading its address only. A message without a
+   *  terminated address is dropped.
+   *  @param buffer the message.
+   *  @param size the size of the message.
+   *  @param now the current time, in the unit of the rules.
+   *  @return true to pass the message on.
+   */
+  bool accept(const char *buffer, int size, uint32_t now);
+
+  /**
+   *  Forget all tracked addresses, the rules stay.
+   */
+  void reset();
+
+  inline uint32_t passed() const { return passed_; };
+  inline uint32_t dropped() const { return dropped_; };
+  inline uint32_t overflows() const { return overflows_; };
+
+private:
+  enum Mode {
+    kMinInterval,
+    kEveryNth,
+    kWindow
+  };
+  struct Rule {
+    const char *pattern;
+    uint8_t length;   // without the '*' of a prefix
+    bool prefix;
+    uint8_t mode;
+    uint16_t count;
+    uint32_t interval;
+  };
+  struct Slot {
+    uint32_t hash;
+    int8_t rule;      // -1 when the slot is free
+    uint16_t count;
+    uint32_t last;
+    uint32_t seen;    // time of the last message, for eviction
+  };
+
+  bool add(const char *pattern, uint8_t mode, uint32_t interval, uint16_t count);
+  void forget();
+  int match(const char *address) const;
+  bool limit(const Rule &rule, Slot &slot, uint32_t now);
+
+  Rule rules_[FOSC_MAX_FILTER_RULES];
+  Slot slots_[FOSC_FILTER_SLOTS];
+  uint32_t misses_[FOSC_FILTER_SLOTS];   // hashes of addresses without a rule
+  uint8_t rule_count_;
+  uint32_t passed_;
+  uint32_t dropped_;
+  uint32_t overflows_;
+};
+
+} } // end namespace fou / osc
+
+#endif
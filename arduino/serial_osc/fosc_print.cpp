@@ -32,10 +32,28 @@
 #include "Arduino.h"
 
 
+// Print has no 64 bit integers.
+static void printInt64(int64_t v) {
+  char digits[21];
+  int n = 0;
+  uint64_t u = v < 0 ? -(uint64_t)v : (uint64_t)v;
+  do {
+    digits[n++] = '0' + (u % 10);
+    u /= 10;
+  } while (u > 0);
+  if (v < 0) Serial.print('-');
+  while (n > 0) Serial.print(digits[--n]);
+}
+
 void printMessage(char *buf, int capacity) {
   fou::osc::MessageIterator mi;
   
   int32_t i32;
+  int64_t i64;
+  double d;
+  char c;
+  uint8_t midi[4];
+  fou::osc::TimeTag_t tt;
   float f;
   uint8_t* blob; blob = 0;
   char* str; str = 0;
@@ -65,6 +83,39 @@ void printMessage(char *buf, int capacity) {
         
         Serial.print("\t\tblob: size("); Serial.print(data_size); Serial.println(")");
         break;
+      case fou::osc::kFOSC_INT64:
+        mi.h(i64);
+        Serial.print("\t\tint64: "); printInt64(i64); Serial.println();
+        break;
+      case fou::osc::kFOSC_TIMETAG:
+        mi.t(tt);
+        Serial.print("\t\ttimetag (sec,frac): "); Serial.print(tt.sec); Serial.print(","); Serial.println(tt.frac);
+        break;
+      case fou::osc::kFOSC_DOUBLE:
+        mi.d(d);
+        Serial.print("\t\tdouble: "); Serial.println(d);
+        break;
+      case fou::osc::kFOSC_SYMBOL:
+        data_size = mi.S(&str);
+        Serial.print("\t\tsymbol: length("); Serial.print(data_size); Serial.print(") "); Serial.println(str);
+        break;
+      case fou::osc::kFOSC_CHAR:
+        mi.c(c);
+        Serial.print("\t\tchar: "); Serial.println(c);
+        break;
+      case fou::osc::kFOSC_MIDI:
+        mi.m(midi);
+        Serial.print("\t\tmidi:");
+        for (int m = 0; m < 4; m++) { Serial.print(" "); Serial.print(midi[m], HEX); }
+        Serial.println();
+        break;
+      case fou::osc::kFOSC_TRUE:
+      case fou::osc::kFOSC_FALSE:
+      case fou::osc::kFOSC_NIL:
+      case fou::osc::kFOSC_INFINITUM:
+        Serial.print("\t\t"); Serial.println((char)mi.arg_type());
+        mi.skip();
+        break;
       default:
         Serial.print("\t\tunknown argument.. bail out\n\n");
         return;
@@ -85,11 +136,11 @@ void printBundle(char *buffer, int size) {
   
   // TODO:: make something in bundle, that makes it easy to see when done.
   while( bi.element(&element_buffer, element_size)) {
-    if (bi.element_is_bundle()) {
+    if (element_size > 0 && element_buffer[0] == '#') {
 //      printBundle(element_buffer, element_size);
       continue;
     }
-    if (bi.element_is_message()) {
+    if (element_size > 0 && element_buffer[0] == '/') {
 //      printMessage(element_buffer, element_size);
       continue;
     }
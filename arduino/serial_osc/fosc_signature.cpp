@@ -0,0 +1,270 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#include "fosc_signature.h"
+#include "fosc_endian.h"
+
+#include <string.h>   // memcpy, memcmp
+
+using namespace fou::osc;
+
+static_assert((FOSC_MAX_SIGNATURES & (FOSC_MAX_SIGNATURES - 1)) == 0,
+              "FOSC_MAX_SIGNATURES must be a power of two");
+static_assert(FOSC_MAX_SIGNATURES <= 64, "signature ids are stored in an int8_t");
+
+static inline uint32_t load_word(const char *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+static inline bool has_zero(uint32_t v) {
+  return ((v - 0x01010101UL) & ~v & 0x80808080UL) != 0;
+}
+
+// p is the last word of a string: the bytes after its '\0' must be zero.
+static inline bool zero_padded(const char *p) {
+  int nul = 0;
+  while (p[nul] != 0) nul++;
+  for (int i = nul + 1; i < 4; i++) {
+    if (p[i] != 0) return false;
+  }
+  return true;
+}
+
+SignatureCache::SignatureCache() : count_(0) {
+  memset(slots_, -1, sizeof(slots_));
+}
+
+uint32_t SignatureCache::hash(const uint32_t *words, int count) {
+  uint32_t h = 2166136261UL;
+  for (int i = 0; i < count; i++) {
+    h = (h ^ words[i]) * 16777619UL;
+  }
+  return h ^ (h >> 16);
+}
+
+int SignatureCache::find(const uint32_t *words, int count, uint32_t h) const {
+  for (int i = 0; i < kSlots; i++) {
+    int id = slots_[(h + i) & (kSlots - 1)];
+    if (id < 0) return -1;
+    const Signature &sig = signatures_[id];
+    if (sig.word_count == count && memcmp(sig.words, words, count * 4) == 0) {
+      return id;
+    }
+  }
+  return -1;
+}
+
+int SignatureCache::intern(const char *typetags) {
+  int n = strlen(typetags);
+  if (n > FOSC_MAX_ARGS) return -1;
+
+  uint32_t words[kMaxWords];
+  int word_count = (n + 2 + 3) / 4;
+  memset(words, 0, sizeof(words));
+  char *p = (char*)words;
+  p[0] = ',';
+  memcpy(p + 1, typetags, n);
+
+  uint32_t h = hash(words, word_count);
+  int id = find(words, word_count, h);
+  if (id >= 0) return id;
+  if (count_ == FOSC_MAX_SIGNATURES) return -1;
+
+  Signature &sig = signatures_[count_];
+  memcpy(sig.words, words, sizeof(words));
+  sig.word_count = word_count;
+  sig.arg_count = n;
+  sig.fixed_count = n;
+  sig.fixed_size = 0;
+  sig.all_words = true;
+  sig.handler = NULL;
+  sig.context = NULL;
+
+  for (int i = 0; i < n; i++) {
+    int size;
+    switch (typetags[i]) {
+      case 'i': case 'f': case 'c': sig.kind[i] = kWord;   size = 4; break;
+      case 'm':                     sig.kind[i] = kMidi;   size = 4; break;
+      case 'h':                     sig.kind[i] = kInt64;  size = 8; break;
+      case 'd':                     sig.kind[i] = kDouble; size = 8; break;
+      case 't':                     sig.kind[i] = kTime;   size = 8; break;
+      case 's': case 'S':           sig.kind[i] = kString; size = -1; break;
+      case 'b':                     sig.kind[i] = kBlob;   size = -1; break;
+      case 'T':                     sig.kind[i] = kTrue;   size = 0; break;
+      case 'F': case 'N': case 'I': sig.kind[i] = kNoData; size = 0; break;
+      default:
+        return -1;
+    }
+    if (sig.kind[i] != kWord) sig.all_words = false;
+    if (size < 0 && sig.fixed_count == n) sig.fixed_count = i;
+    if (sig.fixed_count == n) {
+      sig.offset[i] = sig.fixed_size;
+      sig.fixed_size += size;
+    }
+  }
+
+  for (int i = 0; ; i++) {
+    int8_t &slot = slots_[(h + i) & (kSlots - 1)];
+    if (slot < 0) {
+      slot = count_;
+      break;
+    }
+  }
+  return count_++;
+}
+
+int SignatureCache::on(const char *typetags, Handler handler, void *context) {
+  int id = intern(typetags);
+  if (id >= 0) {
+    signatures_[id].handler = handler;
+    signatures_[id].context = context;
+  }
+  return id;
+}
+
+int SignatureCache::lookup(const char *buffer, int size, int &args) const {
+  // skip the address, a word at a time.
+  int o = 0;
+  while (true) {
+    if (o + 4 > size) return -1;
+    uint32_t w = load_word(buffer + o);
+    o += 4;
+    if (has_zero(w)) break;
+  }
+  if (buffer[0] != '/' || !zero_padded(buffer + o - 4)) return -1;
+  if (o + 4 > size || buffer[o] != ',') return -1;
+
+  uint32_t words[kMaxWords];
+  int count = 0;
+  while (true) {
+    if (count == kMaxWords || o + 4 > size) return -1;
+    words[count] = load_word(buffer + o);
+    o += 4;
+    if (has_zero(words[count++])) break;
+  }
+  args = o;
+  return find(words, count, hash(words, count));
+}
+
+/**
+ *  Load a fixed size argument, the caller has checked it is within the message.
+ */
+inline void SignatureCache::load_fixed(uint8_t kind, const uint8_t *p, Argument_t &arg) {
+  switch (kind) {
+    case kWord: arg.i = (int32_t)endian::load32(p); break;
+    case kMidi: memcpy(arg.m, p, 4); break;
+    case kInt64: endian::load(p, arg.h); break;
+    case kDouble: endian::load(p, arg.d); break;
+    case kTime: endian::load(p, arg.t); break;
+    case kTrue: arg.i = 1; break;
+    default: arg.i = 0; break;
+  }
+}
+
+int SignatureCache::decode(int id, const char *buffer, int size, int args, Argument_t *out) const {
+  if (id < 0 || id >= count_) return -1;
+  const Signature &sig = signatures_[id];
+  const uint8_t *p = (const uint8_t*)buffer + args;
+  int n = sig.arg_count;
+
+  if (sig.fixed_count == n) {
+    if (size - args != sig.fixed_size) return -1;
+    if (sig.all_words) {
+      for (int i = 0; i < n; i++) {
+        out[i].i = (int32_t)endian::load32(p + i * 4);
+      }
+      return n;
+    }
+  } else if (size - args < sig.fixed_size) {
+    return -1;
+  }
+
+  for (int i = 0; i < sig.fixed_count; i++) {
+    load_fixed(sig.kind[i], p + sig.offset[i], out[i]);
+  }
+
+  // past the first string or blob the offsets depend on the data.
+  int o = args + sig.fixed_size;
+  for (int i = sig.fixed_count; i < n; i++) {
+    switch (sig.kind[i]) {
+      case kString: {
+        out[i].s = buffer + o;
+        while (true) {
+          if (o + 4 > size) return -1;
+          uint32_t w = load_word(buffer + o);
+          o += 4;
+          if (has_zero(w)) break;
+        }
+        if (!zero_padded(buffer + o - 4)) return -1;
+        break;
+      }
+      case kBlob: {
+        if (o + 4 > size) return -1;
+        uint32_t length = endian::load32((const uint8_t*)buffer + o);
+        o += 4;
+        if (length > (uint32_t)(size - o)) return -1;
+        out[i].b.size = length;
+        out[i].b.data = (char*)buffer + o;
+        int end = o + ((length + 3) & ~3);
+        if (end > size) return -1;
+        for (o += length; o < end; o++) {
+          if (buffer[o] != 0) return -1;
+        }
+        break;
+      }
+      case kWord: case kMidi:
+        if (o + 4 > size) return -1;
+        load_fixed(sig.kind[i], (const uint8_t*)buffer + o, out[i]);
+        o += 4;
+        break;
+      case kInt64: case kDouble: case kTime:
+        if (o + 8 > size) return -1;
+        load_fixed(sig.kind[i], (const uint8_t*)buffer + o, out[i]);
+        o += 8;
+        break;
+      default:
+        load_fixed(sig.kind[i], NULL, out[i]);
+        break;
+    }
+  }
+  return o == size ? n : -1;
+}
+
+int SignatureCache::dispatch(const char *buffer, int size) const {
+  int args;
+  int id = lookup(buffer, size, args);
+  if (id < 0 || signatures_[id].handler == NULL) return -1;
+
+  Argument_t out[FOSC_MAX_ARGS];
+  int n = decode(id, buffer, size, args, out);
+  if (n < 0) return -1;
+  signatures_[id].handler(buffer, out, n, signatures_[id].context);
+  return id;
+}
@@ -0,0 +1,165 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#ifndef FOSC_SIGNATURE_H_
+#define FOSC_SIGNATURE_H_
+
+#include "stdint.h"
+
+#include "fosc.h"
+
+namespace fou {
+namespace osc {
+
+#ifndef FOSC_MAX_SIGNATURES
+#define FOSC_MAX_SIGNATURES 8 /** signatures a SignatureCache can intern */
+#endif
+
+/**
+ *  A decoded argument. Which member holds the value follows from its type
+ *  tag: i for 'i' and 'c', f, h, d, t, s for 's' and 'S', b, m. T, F, N
+ *  and I carry no data, i is 1 for 'T' and 0 for the others.
+ */
+typedef union {
+	int32_t i;
+	float f;
+	int64_t h;
+	double d;
+	TimeTag_t t;
+	const char *s;
+	Blob_t b;
+	uint8_t m[4];
+} Argument_t;
+
+/**
+ *  Interns type tag strings to small ids, keyed by their padded 4 byte
+ *  words. Every id has a precomputed layout: how every argument is loaded
+ *  and, up to the first string or blob, its fixed offset. A message is
+ *  matched by hashing and comparing its type tag words, then decoded from
+ *  that layout. Signatures of 32 bit words only (i, f, c) are loaded in one
+ *  straight loop. Others switch on the precomputed kind of every argument,
+ *  not on its type tag, and need no size checks up to the first string or
+ *  blob. Handlers registered for a signature receive the decoded arguments.
+ *
+ *    void on_fff(const char *address, const Argument_t *args, int count, void *context);
+ *
+ *    SignatureCache cache;
+ *    cache.on("fff", on_fff, NULL);
+ *    if (cache.dispatch(buf, size) < 0) {
+ *      // not a registered signature, fall back to a MessageIterator.
+ *    }
+ */
+class SignatureCache {
+public:
+  typedef void (*Handler)(const char *address, const Argument_t *args, int count, void *context);
+
+  SignatureCache();
+
+  /**
+   *  Intern a type tag string.
+   *  @param typetags the type tags, without ','.
+   *  @return the id, or -1 when the cache is full or a tag is unknown.
+   */
+  int intern(const char *typetags);
+  /**
+   *  Intern a type tag string and register a handler for it.
+   *  @return the id, or -1.
+   */
+  int on(const char *typetags, Handler handler, void *context);
+
+  /**
+   *  Find the signature of a message. The message does not need to have been
+   *  validated, all reads are bounded by size. Padding must be zero, as for
+   *  validateMessage().
+   *  @param buffer the message.
+   *  @param size the size of the message.
+   *  @param args set to the offset of the first argument.
+   *  @return the id, or -1 for a signature that has not been interned.
+   */
+  int lookup(const char *buffer, int size, int &args) const;
+  /**
+   *  Decode the arguments of a message with a known signature.
+   *  @param id the signature of the message, from lookup().
+   *  @param out FOSC_MAX_ARGS arguments.
+   *  @return the number of arguments, or -1 when the message is malformed.
+   */
+  int decode(int id, const char *buffer, int size, int args, Argument_t *out) const;
+  /**
+   *  Look up a message, decode it and call its handler.
+   *  @return the id, or -1 when the signature is unknown, has no handler,
+   *  or the message is malformed.
+   */
+  int dispatch(const char *buffer, int size) const;
+
+  /**
+   *  @return the number of interned signatures.
+   */
+  inline int size() const { return count_; };
+
+private:
+  enum {
+    kMaxWords = (FOSC_MAX_ARGS + 2 + 3) / 4,   // ',' tags '\0' and padding
+    kSlots = FOSC_MAX_SIGNATURES * 2           // hash slots, power of two
+  };
+  // how an argument is loaded.
+  enum Kind {
+    kWord,    // i f c
+    kMidi,
+    kInt64,
+    kDouble,
+    kTime,
+    kString,  // s S
+    kBlob,
+    kTrue,
+    kNoData   // F N I
+  };
+  struct Signature {
+    uint32_t words[kMaxWords];
+    uint8_t word_count;
+    uint8_t arg_count;
+    uint8_t fixed_count;  // arguments before the first string or blob
+    bool all_words;       // every argument is i, f or c
+    uint16_t fixed_size;  // size of the fixed arguments
+    uint8_t kind[FOSC_MAX_ARGS];
+    uint16_t offset[FOSC_MAX_ARGS]; // valid for the fixed arguments
+    Handler handler;
+    void *context;
+  };
+
+  static void load_fixed(uint8_t kind, const uint8_t *p, Argument_t &arg);
+  static uint32_t hash(const uint32_t *words, int count);
+  int find(const uint32_t *words, int count, uint32_t h) const;
+
+  Signature signatures_[FOSC_MAX_SIGNATURES];
+  int8_t slots_[kSlots];
+  int count_;
+};
+
+} } // end namespace fou / osc
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#ifndef FOSC_STRUCT_H_
+#define FOSC_STRUCT_H_
+
+#include "stdint.h"
+#include "string.h" // memcmp, strlen
+
+#include "fosc.h"
+#include "fosc_endian.h"
+
+namespace fou {
+namespace osc {
+
+/**
+ *  The OSC type of a C++ type. Specialized for every type a struct field
+ *  can have.
+ */
+template <typename T> struct TypeTagOf;
+template <> struct TypeTagOf<int32_t> { enum { tag = kFOSC_INT32, size = 4 }; };
+template <> struct TypeTagOf<float>   { enum { tag = kFOSC_FLOAT, size = 4 }; };
+template <> struct TypeTagOf<int64_t> { enum { tag = kFOSC_INT64, size = 8 }; };
+template <> struct TypeTagOf<double>  { enum { tag = kFOSC_DOUBLE, size = 8 }; };
+template <> struct TypeTagOf<TimeTag_t> { enum { tag = kFOSC_TIMETAG, size = 8 }; };
+
+/**
+ *  One field of a struct, see FOSC_FIELD.
+ */
+template <typename S, typename M, M S::*Member>
+struct Field {
+  enum { tag = TypeTagOf<M>::tag, size = TypeTagOf<M>::size };
+  static inline void store(uint8_t *out, const S &s) { endian::store(out, s.*Member); }
+  static inline void load(const uint8_t *in, S &s) { endian::load(in, s.*Member); }
+};
+
+/**
+ *  Describe a member of struct S as an OSC argument.
+ */
+#define FOSC_FIELD(S, member) ::fou::osc::Field<S, decltype(S::member), &S::member>
+
+/**
+ *  The fields of a struct at their offsets in the message. Unrolled at
+ *  compile time into straight line stores and loads.
+ */
+template <typename S, int Offset, typename... Fields>
+struct FieldList {
+  enum { size = 0 };
+  static inline void store(uint8_t *, const S &) {}
+  static inline void load(const uint8_t *, S &) {}
+};
+
+template <typename S, int Offset, typename F, typename... Rest>
+struct FieldList<S, Offset, F, Rest...> {
+  typedef FieldList<S, Offset + F::size, Rest...> Next;
+  enum { size = F::size + Next::size };
+  static inline void store(uint8_t *out, const S &s) {
+    F::store(out + Offset, s);
+    Next::store(out, s);
+  }
+  static inline void load(const uint8_t *in, S &s) {
+    F::load(in + Offset, s);
+    Next::load(in, s);
+  }
+};
+
+/**
+ *  Maps a plain struct to an OSC message. The type tags and the offsets of
+ *  the arguments are fixed at compile time, so encoding and decoding are a
+ *  type tag compare and straight line loads and stores.
+ *
+ *    struct Imu { float ax, ay, az; int32_t t; };
+ *    typedef fou::osc::Schema<Imu, FOSC_FIELD(Imu, ax), FOSC_FIELD(Imu, ay),
+ *                             FOSC_FIELD(Imu, az), FOSC_FIELD(Imu, t)> ImuSchema;
+ *
+ *    int size = ImuSchema::encode(buf, capacity, "/imu", imu);
+ *    if (ImuSchema::decode(buf, size, imu)) ...
+ */
+template <typename S, typename... Fields>
+class Schema {
+public:
+  enum {
+    kArgs = sizeof...(Fields),
+    kTypesSize = (kArgs + 2 + 3) & ~3,   // ',' tags '\0' and padding
+    kArgsSize = FieldList<S, 0, Fields...>::size
+  };
+
+  /**
+   *  @return the type tag string, without ','.
+   */
+  static inline const char *types() { return typetags_ + 1; }
+
+  /**
+   *  @return the size of the message with the given address.
+   */
+  static inline int size(const char *addr) {
+    return ((strlen(addr) + 4) & ~3) + kTypesSize + kArgsSize;
+  }
+
+  /**
+   *  Encode a struct.
+   *  @param buffer the output buffer.
+   *  @param capacity the output buffer capacity.
+   *  @param addr is the OSC address.
+   *  @param s the struct.
+   *  @return the size of the message, 0 when it does not fit.
+   */
+  static int encode(char *buffer, int capacity, const char *addr, const S &s) {
+    int len = strlen(addr);
+    int args = (len + 4) & ~3;
+    if (args + kTypesSize + kArgsSize > capacity) return 0;
+    memcpy(buffer, addr, len);
+    memset(buffer + len, 0, args - len);
+    memcpy(buffer + args, typetags_, kTypesSize);
+    args += kTypesSize;
+    FieldList<S, 0, Fields...>::store((uint8_t *)buffer + args, s);
+    return args + kArgsSize;
+  }
+
+  /**
+   *  Decode a message into a struct. Fails unless the type tags match
+   *  exactly and the message holds all arguments.
+   *  @param buffer the message.
+   *  @param size the size of the message.
+   *  @param s the struct.
+   *  @return true on success.
+   */
+  static bool decode(const char *buffer, int size, S &s) {
+    const char *end = (const char *)memchr(buffer, 0, size);
+    if (end == NULL) return false;
+    int types = (end - buffer + 4) & ~3;
+    if (types + kTypesSize + kArgsSize > size) return false;
+    if (memcmp(buffer + types, typetags_, kTypesSize) != 0) return false;
+    FieldList<S, 0, Fields...>::load((const uint8_t *)buffer + types + kTypesSize, s);
+    return true;
+  }
+
+  /**
+   *  Decode the message of a message iterator, after decode() has been
+   *  called on it.
+   *  @return true on success.
+   */
+  template <typename Size_t>
+  static bool decode(const BasicMessageIterator<Size_t> &mi, S &s) {
+    const char *tags = mi.types();
+    if (tags == NULL || mi.args_size() != kArgs) return false;
+    if (memcmp(tags - 1, typetags_, kTypesSize) != 0) return false;
+    FieldList<S, 0, Fields...>::load((const uint8_t *)tags - 1 + kTypesSize, s);
+    return true;
+  }
+
+private:
+  // ',' the tags and zero padding, compared and copied as a whole.
+  static const char typetags_[kArgs + 5];
+};
+
+template <typename S, typename... Fields>
+const char Schema<S, Fields...>::typetags_[kArgs + 5] = { ',', (char)Fields::tag..., 0, 0, 0, 0 };
+
+} } // end namespace fou / osc
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#include "fosc_validate.h"
+#include "fosc_endian.h"
+
+#include <string.h>   // memcpy, memcmp
+
+using namespace fou::osc;
+
+/*
+ *  OSC strings start on a 4 byte boundary and are padded to the next one, so
+ *  they can be scanned a word at a time. A word holds the terminator when it
+ *  has a zero byte, and everything after the terminator must be zero too.
+ */
+
+static inline uint32_t load_word(const char *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+static inline bool has_zero(uint32_t v) {
+  return ((v - 0x01010101UL) & ~v & 0x80808080UL) != 0;
+}
+
+/**
+ *  Find the end of the padded string at offset, which is 4 byte aligned.
+ *  @param length optional, set to the length of the string.
+ *  @return the offset after the padding, or -1 for a string that is not
+ *  terminated within size, or -2 for non zero padding.
+ */
+static int scan_string(const char *buffer, int offset, int size, int *length = NULL) {
+  int start = offset;
+  while (offset + 4 <= size) {
+    uint32_t w = load_word(buffer + offset);
+    if (has_zero(w)) {
+      const char *p = buffer + offset;
+      int nul = 0;
+      while (p[nul] != 0) nul++;
+      for (int i = nul + 1; i < 4; i++) {
+        if (p[i] != 0) return -2;
+      }
+      if (length != NULL) *length = offset + nul - start;
+      return offset + 4;
+    }
+    offset += 4;
+  }
+  return -1;
+}
+
+static inline Validation_t string_error(int r, Validation_t unterminated) {
+  return r == -2 ? kFOSC_ERR_PADDING : unterminated;
+}
+
+Validation_t fou::osc::validateMessage(const char *buffer, int size, MessageLayout_t *layout) {
+  if (size < 8 || (size & 3) != 0 || size > 0xffff) return kFOSC_ERR_SIZE;
+  if (buffer[0] != '/') return kFOSC_ERR_ADDRESS;
+
+  int offset = scan_string(buffer, 0, size);
+  if (offset < 0) return string_error(offset, kFOSC_ERR_ADDRESS);
+  if (offset == size || buffer[offset] != ',') return kFOSC_ERR_TYPETAGS;
+
+  int types = offset + 1;
+  int types_size;
+  offset = scan_string(buffer, offset, size, &types_size);
+  if (offset < 0) return string_error(offset, kFOSC_ERR_TYPETAGS);
+  types_size--; // the ','
+  if (layout != NULL) {
+    if (types_size > FOSC_MAX_ARGS) return kFOSC_ERR_TOO_MANY_ARGS;
+    layout->types = types;
+    layout->types_size = types_size;
+    layout->args = offset;
+  }
+
+  for (int a = 0; a < types_size; a++) {
+    if (layout != NULL) layout->arg[a] = offset;
+    int r;
+    switch (buffer[types + a]) {
+      case kFOSC_INT32:
+      case kFOSC_FLOAT:
+      case kFOSC_CHAR:
+      case kFOSC_MIDI:
+        offset += 4;
+        break;
+      case kFOSC_INT64:
+      case kFOSC_TIMETAG:
+      case kFOSC_DOUBLE:
+        offset += 8;
+        break;
+      case kFOSC_STRING:
+      case kFOSC_SYMBOL:
+        r = scan_string(buffer, offset, size);
+        if (r < 0) return string_error(r, kFOSC_ERR_ARGUMENT);
+        offset = r;
+        break;
+      case kFOSC_BLOB: {
+        if (offset + 4 > size) return kFOSC_ERR_ARGUMENT;
+        uint32_t blob = endian::load32((const uint8_t *)buffer + offset);
+        offset += 4;
+        if (blob > (uint32_t)(size - offset)) return kFOSC_ERR_ARGUMENT;
+        int end = offset + (int)blob;
+        offset = (end + 3) & ~3;
+        if (offset > size) return kFOSC_ERR_ARGUMENT;
+        for (int i = end; i < offset; i++) {
+          if (buffer[i] != 0) return kFOSC_ERR_PADDING;
+        }
+        break;
+      }
+      case kFOSC_TRUE:
+      case kFOSC_FALSE:
+      case kFOSC_NIL:
+      case kFOSC_INFINITUM:
+        break;
+      default:
+        return kFOSC_ERR_UNKNOWN_TYPE;
+    }
+    if (offset > size) return kFOSC_ERR_ARGUMENT;
+  }
+  if (offset != size) return kFOSC_ERR_TRAILING;
+  if (layout != NULL) layout->size = size;
+  return kFOSC_VALID;
+}
+
+Validation_t fou::osc::validateBundle(const char *buffer, int size, int depth) {
+  static const char header[8] = {'#', 'b', 'u', 'n', 'd', 'l', 'e', 0};
+  if (depth <= 0) return kFOSC_ERR_DEPTH;
+  if (size < 16 || (size & 3) != 0) return kFOSC_ERR_SIZE;
+  if (memcmp(buffer, header, 8) != 0) return kFOSC_ERR_BUNDLE;
+
+  int offset = 16; // header and time tag
+  while (offset < size) {
+    if (offset + 4 > size) return kFOSC_ERR_BUNDLE;
+    uint32_t element = endian::load32((const uint8_t *)buffer + offset);
+    offset += 4;
+    if (element == 0 || (element & 3) != 0 || element > (uint32_t)(size - offset)) return kFOSC_ERR_BUNDLE;
+    Validation_t v;
+    if (buffer[offset] == '#') v = validateBundle(buffer + offset, element, depth - 1);
+    else v = validateMessage(buffer + offset, element);
+    if (v != kFOSC_VALID) return v;
+    offset += element;
+  }
+  return kFOSC_VALID;
+}
+
+Validation_t fou::osc::validatePacket(const char *buffer, int size) {
+  if (size < 1) return kFOSC_ERR_SIZE;
+  if (buffer[0] == '#') return validateBundle(buffer, size);
+  return validateMessage(buffer, size);
+}
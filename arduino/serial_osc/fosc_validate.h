@@ -0,0 +1,86 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#ifndef FOSC_VALIDATE_H_
+#define FOSC_VALIDATE_H_
+
+#include "stdint.h"
+
+#include "fosc.h"
+
+namespace fou {
+namespace osc {
+
+#ifndef FOSC_MAX_BUNDLE_DEPTH
+#define FOSC_MAX_BUNDLE_DEPTH 8 /** bundles nested deeper are rejected */
+#endif
+
+typedef enum {
+	kFOSC_VALID = 0,
+	kFOSC_ERR_SIZE,           /** not a multiple of 4, too small, or a message above 0xffff bytes */
+	kFOSC_ERR_ADDRESS,        /** no '/', or not terminated within the packet */
+	kFOSC_ERR_PADDING,        /** non zero padding */
+	kFOSC_ERR_TYPETAGS,       /** no ',', or not terminated within the packet */
+	kFOSC_ERR_UNKNOWN_TYPE,   /** a type tag that has no known size */
+	kFOSC_ERR_ARGUMENT,       /** an argument runs past the end of the packet */
+	kFOSC_ERR_TRAILING,       /** bytes after the last argument */
+	kFOSC_ERR_TOO_MANY_ARGS,  /** more than FOSC_MAX_ARGS, with a layout */
+	kFOSC_ERR_BUNDLE,         /** bad bundle header or element size */
+	kFOSC_ERR_DEPTH           /** bundles nested too deep */
+} Validation_t;
+
+/**
+ *  Validate an untrusted OSC message in one pass: the address and the type
+ *  tags are terminated and zero padded within the packet, and every argument
+ *  fits. Once a message is valid, MessageIterator cannot read past it.
+ *  Messages above 0xffff bytes are rejected, MessageLayout_t is 16 bit.
+ *  @param buffer the message.
+ *  @param size the size of the packet.
+ *  @param layout optional, filled with the offsets of the arguments. Pass it
+ *         to MessageIterator::decode() to skip a second scan.
+ *  @return kFOSC_VALID or the first problem found.
+ */
+Validation_t validateMessage(const char *buffer, int size, MessageLayout_t *layout = NULL);
+
+/**
+ *  Validate an untrusted OSC bundle and, recursively, all its elements.
+ *  @param buffer the bundle.
+ *  @param size the size of the packet.
+ *  @param depth the number of nesting levels allowed.
+ *  @return kFOSC_VALID or the first problem found.
+ */
+Validation_t validateBundle(const char *buffer, int size, int depth = FOSC_MAX_BUNDLE_DEPTH);
+
+/**
+ *  Validate a message or a bundle, whichever the packet holds.
+ */
+Validation_t validatePacket(const char *buffer, int size);
+
+} } // end namespace fou / osc
+
+#endif
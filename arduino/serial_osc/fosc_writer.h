@@ -0,0 +1,258 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#ifndef FOSC_WRITER_H_
+#define FOSC_WRITER_H_
+
+#include "stdint.h"
+#include "string.h" // strlen, memcpy
+
+#include "fosc.h"
+#include "fosc_endian.h"
+
+namespace fou {
+namespace osc {
+
+/**
+ *  Sink that writes into a plain buffer. A sink takes whole fields: write()
+ *  either stores all n bytes or nothing.
+ */
+class BufferSink {
+public:
+  BufferSink(char *buffer, int capacity) : buffer_(buffer), capacity_(capacity), size_(0) {};
+
+  inline bool write(const uint8_t *src, int n) {
+    if (size_ + n > capacity_) return false;
+    memcpy(&buffer_[size_], src, n);
+    size_ += n;
+    return true;
+  }
+  inline int size() const { return size_; };
+
+private:
+  char *buffer_;
+  int capacity_;
+  int size_;
+};
+
+/**
+ *  Sink that only counts bytes. Used to size a bundle element before it is
+ *  written, since the size precedes the element.
+ */
+class SizeSink {
+public:
+  SizeSink() : size_(0) {};
+  inline bool write(const uint8_t *, int n) { size_ += n; return true; }
+  inline int size() const { return size_; };
+
+private:
+  int size_;
+};
+
+/**
+ *  Sink that SLIP escapes straight into a slip::Encoder or slip::StaticEncoder.
+ *  Every field is checked against its exact escaped size before it is
+ *  written, so no intermediate OSC buffer is needed.
+ */
+template <class Encoder>
+class SlipSink {
+public:
+  SlipSink(Encoder &encoder) : encoder_(encoder), size_(0) {};
+
+  inline bool write(const uint8_t *src, int n) {
+    if (!encoder_.pushBack(src, n)) return false;
+    size_ += n;
+    return true;
+  }
+  /**
+   *  End the SLIP packet.
+   */
+  inline bool end() { return encoder_.endPacket(); }
+  /**
+   *  @return the unescaped number of bytes written.
+   */
+  inline int size() const { return size_; };
+
+private:
+  Encoder &encoder_;
+  int size_;
+};
+
+/**
+ *  Encodes an OSC message into a sink, field by field. This is the
+ *  streaming counterpart of MessageIterator::encode() and the append 
+ *  functions: nothing is written back, so the output can be escaped or sent
+ *  as it is produced.
+ *
+ *  For the same reason a failed call cannot be undone: the fields written
+ *  before it stay in the sink. Discard the message when a call returns
+ *  false, e.g. clear() the SLIP encoder instead of ending the frame.
+ *
+ *    fou::slip::StaticEncoder<128> slip;
+ *    fou::osc::SlipSink<fou::slip::StaticEncoder<128> > sink(slip);
+ *    fou::osc::MessageWriter<fou::osc::SlipSink<fou::slip::StaticEncoder<128> > > mw(sink);
+ *    mw.begin("/foo", "fi");
+ *    mw.append_f(12.34);
+ *    mw.append_i(129);
+ *    sink.end();
+ */
+template <class Sink>
+class MessageWriter {
+public:
+  MessageWriter(Sink &sink) : sink_(sink), size_(0) {};
+
+  /**
+   *  Write the address and the type tag string.
+   *  @param addr is the OSC address.
+   *  @param typetags is the string with arguments, without ','.
+   *  @return true on success. 
+   */
+  bool begin(const char *addr, const char *typetags) {
+    size_ = 0;
+    if (!write_string(addr)) return false;
+    // ',' and the tags are padded together, as one string.
+    int len = strlen(typetags);
+    uint8_t comma = ',';
+    if (!write(&comma, 1)) return false;
+    if (!write((const uint8_t *)typetags, len)) return false;
+    return write_zeros(4 - ((len + 1) & 3));
+  }
+  bool append_i(int32_t i) { return append_u32((uint32_t)i); }
+  bool append_f(float f) { return append_value(f, 4); }
+  bool append_s(const char *s) { return write_string(s); }
+  bool append_b(const uint8_t *data, int32_t size) {
+    if (size < 0) return false;
+    if (!append_u32((uint32_t)size)) return false;
+    if (!write(data, size)) return false;
+    return write_zeros((4 - (size & 3)) & 3);
+  }
+  // extended OSC types. T, F, N and I have no data.
+  bool append_h(int64_t h) { return append_value(h, 8); }
+  bool append_t(const TimeTag_t &t) { return append_value(t, 8); }
+  bool append_d(double d) { return append_value(d, 8); }
+  bool append_S(const char *s) { return write_string(s); }
+  bool append_c(char c) { return append_u32((uint8_t)c); }
+  bool append_m(const uint8_t *midi) { return write(midi, 4); }
+  /**
+   *  @return the size of the message written so far.
+   */
+  inline int size() const { return size_; };
+
+private:
+  inline bool write(const uint8_t *src, int n) {
+    if (!sink_.write(src, n)) return false;
+    size_ += n;
+    return true;
+  }
+  inline bool write_zeros(int n) {
+    static const uint8_t zeros[4] = {0, 0, 0, 0};
+    return write(zeros, n);
+  }
+  // string including its '\0' and padding.
+  bool write_string(const char *s) {
+    int len = strlen(s);
+    if (!write((const uint8_t *)s, len)) return false;
+    return write_zeros(4 - (len & 3));
+  }
+  // network byte order.
+  inline bool append_u32(uint32_t v) {
+    uint8_t b[4];
+    endian::store32(b, v);
+    return write(b, 4);
+  }
+  // size is the size on the wire.
+  template <typename T>
+  inline bool append_value(const T &v, int size) {
+    uint8_t b[8];
+    endian::store(b, v);
+    return write(b, size);
+  }
+
+  Sink &sink_;
+  int size_;
+};
+
+/**
+ *  Encodes an OSC bundle into a sink. Every element is preceded by its size,
+ *  use a MessageWriter on a SizeSink to find it.
+ *
+ *    SizeSink count;
+ *    MessageWriter<SizeSink>(count) ... ;    // same calls as below
+ *    bw.element(count.size());
+ *    MessageWriter<Sink> mw(sink); ...
+ */
+template <class Sink>
+class BundleWriter {
+public:
+  BundleWriter(Sink &sink) : sink_(sink), size_(0) {};
+
+  /**
+   *  Write the bundle header.
+   *  @param sec seconds.
+   *  @param frac fraction of a second.
+   */
+  bool begin(uint32_t sec, uint32_t frac) {
+    static const uint8_t header[8] = {'#', 'b', 'u', 'n', 'd', 'l', 'e', 0};
+    size_ = 0;
+    if (!write(header, 8)) return false;
+    if (!write_u32(sec)) return false;
+    return write_u32(frac);
+  }
+  /**
+   *  Start an element of the given size. The caller writes the element
+   *  itself to the same sink.
+   */
+  bool element(uint32_t size) {
+    if (!write_u32(size)) return false;
+    size_ += size;
+    return true;
+  }
+  /**
+   *  @return the size of the bundle, including the elements announced.
+   */
+  inline int size() const { return size_; };
+
+private:
+  inline bool write(const uint8_t *src, int n) {
+    if (!sink_.write(src, n)) return false;
+    size_ += n;
+    return true;
+  }
+  inline bool write_u32(uint32_t v) {
+    uint8_t b[4];
+    endian::store32(b, v);
+    return write(b, 4);
+  }
+
+  Sink &sink_;
+  int size_;
+};
+
+} } // end namespace fou / osc
+
+#endif
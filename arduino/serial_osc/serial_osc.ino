@@ -35,21 +35,16 @@ void setup() {
   
   Serial.println("start");
   
-  const int buffer_size = 1024;
+  // owns a 64 byte buffer, sizes are kept in a uint8_t.
+  fou::osc::StaticMessage<64> mi;
   
-  char buf[buffer_size];
-  
-  
-  
-  fou::osc::MessageIterator mi;
-  
-  mi.encode(buf, buffer_size, "/foo/", "fisb");
+  mi.encode("/foo/", "fisb");
   mi.append_f(12.34);
   mi.append_i(129);
   mi.append_s("daniel");
   mi.append_b( (uint8_t*)&(blob_data[0]) , 25);
   
-  printMessage(&(buf[0]), 1024);
+  printMessage(mi.data(), mi.capacity());
 
   Serial.println();
 
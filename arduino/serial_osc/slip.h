@@ -33,6 +33,9 @@
 
 #include "stdint.h"
 #include "assert.h"
+#include "string.h" // memchr, memmove
+
+#include "capacity.h"
 
 namespace fou {
 namespace slip {
@@ -45,13 +48,48 @@ enum SpecialCharacters {
 };
 
 
-class Decoder {
+/**
+ *  Frame integrity check, the Check parameter of the encoders and decoders.
+ *  NoCheck sends frames as they are. crc::Crc16 and crc::Crc32c (crc.h)
+ *  append a CRC trailer on encoding, and verify and strip it on decoding.
+ *  Frames that fail are dropped before they reach the OSC parser.
+ */
+struct NoCheck {
+  enum { kSize = 0 };
+  inline void reset() {}
+  inline void update( uint8_t ) {}
+  inline void update( const uint8_t *, int ) {}
+  inline void trailer( uint8_t * ) const {}
+  inline bool check() { return true; }
+  inline void fail() {}
+  inline uint32_t failures() const { return 0; }
+};
+
+
+/**
+ *  SLIP receive state machine. The storage is provided by the derived class
+ *  through buffer() and capacity(), so the same code serves Decoder, which
+ *  decodes into an external buffer, and StaticDecoder, which owns its buffer.
+ *
+ *  A derived class can also follow the frame as it arrives by hiding the
+ *  frameByte(), frameEnd(), frameReset() and frameError() hooks. The empty
+ *  defaults below cost nothing.
+ *
+ *  The check is a base class, so NoCheck takes no RAM.
+ */
+template <class Derived, typename Index_t, class Check = NoCheck>
+class BasicDecoder : protected Check {
  public:
-   Decoder(uint8_t *buffer, int capacity) : mBuffer(buffer), mCapacity(capacity), mPacketLength(0), mEscMode(false), mReady(false)
+   BasicDecoder() : mPacketLength(0), mEscMode(false), mReady(false)
     { 
     }
     
-    inline void clear() { mPacketLength = 0; mReady = false; }
+    inline void clear() { mPacketLength = 0; mReady = false; Check::reset(); derived()->frameReset(); }
+
+    /**
+     *  @return the number of frames dropped because the check failed.
+     */
+    inline uint32_t badFrames() const { return Check::failures(); }
     
     inline int getSize() const { return mPacketLength; }
     
@@ -59,19 +97,19 @@ class Decoder {
     
     int16_t getAsI16( int i ) {
       int16_t o;
-      *(((uint8_t *)&o ) + 1) = mBuffer[i];
-      *(uint8_t *)&o = mBuffer[i+1];
+      *(((uint8_t *)&o ) + 1) = data()[i];
+      *(uint8_t *)&o = data()[i+1];
       return o;
     }
     
     inline uint16_t getAsU16( int i ) {
       assert( (i >= 0) and ( i+1 < mPacketLength) );
-      return ((uint16_t)mBuffer[i] << 8) | (uint16_t)mBuffer[i+1];
+      return ((uint16_t)data()[i] << 8) | (uint16_t)data()[i+1];
     }
 
     inline uint8_t getByte( int i ) {
       assert( (i >= 0) and (i < mPacketLength) );
-      return mBuffer[i];
+      return data()[i];
     }
 
     bool pushBack( uint8_t c) 
@@ -86,71 +124,142 @@ class Decoder {
             break;
           default:
             // protocol violation.
+            derived()->frameError();
             return false;
         }
         
-        if( mPacketLength == mCapacity ) return false;
+        if( mPacketLength == capacity() ) { derived()->frameError(); return false; }
         // when we are ready and receive something new. 
         // discard old stuff in favour for new stuff.
         if( mReady ) clear();
-        mBuffer[mPacketLength] = c;
+        data()[mPacketLength] = c;
+        Check::update(c);
+        derived()->frameByte(c);
         mPacketLength++;
         mEscMode = false;
         return true;
       }
       switch( c ) {
         case slip::kEnd:
-          if (mPacketLength == 0) break; // ignore end with zero length
+          // ignore end with zero length, and repeated ends after a frame:
+          // the trailer has been stripped already.
+          if (mPacketLength == 0 || mReady) break;
+          if (Check::kSize > 0) {
+            // drop corrupted frames, strip the trailer of good ones.
+            if (mPacketLength <= (int)Check::kSize) { Check::fail(); clear(); break; }
+            if (!Check::check()) { clear(); break; }
+            mPacketLength -= Check::kSize;
+          }
           // confirm packet
           mReady = true;
+          derived()->frameEnd();
           break;
         case slip::kEsc:
           mEscMode = true;
           break;
         default:
-          if( mPacketLength == mCapacity ) return false;
+          if( mPacketLength == capacity() ) { derived()->frameError(); return false; }
           
           // when we are ready and receive something new. 
           // discard old stuff in favour for new stuff.
           if( mReady ) clear();
-          mBuffer[mPacketLength] = c;
+          data()[mPacketLength] = c;
+          Check::update(c);
+          derived()->frameByte(c);
           mPacketLength++;
       }
       return true;
     }
 
  protected:
-   uint8_t *mBuffer;
-   int mCapacity;
-   int mPacketLength;
+   // hooks, called with the unescaped byte before mPacketLength is advanced.
+   inline void frameByte( uint8_t ) {}
+   inline void frameEnd() {}
+   inline void frameReset() {}
+   inline void frameError() {}
+
+   inline Derived *derived() { return static_cast<Derived *>(this); }
+   inline uint8_t *data() { return derived()->buffer(); }
+   inline Index_t capacity() const { return static_cast<const Derived *>(this)->capacity(); }
+
+   Index_t mPacketLength;
    bool mEscMode;
    bool mReady;
 };
 
-  
-class Encoder {
+
+/**
+ *  SLIP decoder on an external buffer.
+ */
+class Decoder : public BasicDecoder<Decoder, int> {
+ public:
+   Decoder(uint8_t *buffer, int capacity) : mBuffer(buffer), mCapacity(capacity)
+    { 
+    }
+
+    inline uint8_t *buffer() { return mBuffer; }
+    inline int capacity() const { return mCapacity; }
+
+ protected:
+   uint8_t *mBuffer;
+   int mCapacity;
+};
+
+
+/**
+ *  SLIP decoder that owns a buffer of Capacity bytes. Packet lengths are
+ *  stored in the smallest type that fits the capacity. The buffer holds the
+ *  check trailer too.
+ */
+template <uint32_t Capacity, class Check = NoCheck>
+class StaticDecoder : public BasicDecoder<StaticDecoder<Capacity, Check>, typename IndexFor<Capacity>::type, Check> {
+ public:
+    static_assert(Capacity > 0, "slip::StaticDecoder needs a non-empty buffer");
+    typedef typename IndexFor<Capacity>::type Index_t;
+
+    inline uint8_t *buffer() { return mBuffer; }
+    inline Index_t capacity() const { return Capacity; }
+
+ protected:
+   uint8_t mBuffer[Capacity];
+};
+
+
+/**
+ *  SLIP transmit side. Like BasicDecoder, storage comes from the derived class.
+ *  With a Check, endPacket() appends the escaped trailer before kEnd.
+ */
+template <class Derived, typename Index_t, class Check = NoCheck>
+class BasicEncoder : protected Check {
   public:
-    Encoder(uint8_t *aBuffer, int aCapacity) : mBuffer(aBuffer), mCapacity(aCapacity),  mPacketLength(0)
+    BasicEncoder() : mPacketLength(0)
     {
     }
     bool endPacket()
     {
-      if ( mPacketLength == mCapacity ) return false;
-      mBuffer[mPacketLength] = slip::kEnd;
+      if (Check::kSize > 0) {
+        uint8_t trailer[Check::kSize + 1];
+        Check::trailer(trailer);
+        if ( escapedSize(trailer, Check::kSize) + 1 > capacityLeft() ) return false;
+        escape(trailer, Check::kSize);
+        Check::reset();
+      }
+      if ( mPacketLength == capacity() ) return false;
+      data()[mPacketLength] = slip::kEnd;
       mPacketLength++;
       return true;
     }
 
     inline int getSize() { return mPacketLength; }
-    inline int capacityLeft() { return mCapacity - mPacketLength; }
+    inline int capacityLeft() { return capacity() - mPacketLength; }
 
     inline bool isEmpty() { return mPacketLength == 0 ?  true : false; }
 
-    inline void clear() { mPacketLength = 0; };
+    inline void clear() { mPacketLength = 0; Check::reset(); };
 
     inline uint8_t getByte( int i ) {
       assert( (i >= 0) and (i < mPacketLength) );
-      return mBuffer[i]; 
+      return data()[i]; 
     }
     bool pushBackU16( uint16_t v )
     {
@@ -159,31 +268,234 @@ class Encoder {
         return r;
     }
 
+    /**
+     *  @return the number of bytes n bytes of data take once escaped.
+     */
+    static int escapedSize( const uint8_t *src, int n )
+    {
+      int size = n;
+      for (int i = 0; i < n; i++) {
+        if (src[i] == slip::kEnd || src[i] == slip::kEsc) size++;
+      }
+      return size;
+    }
+
+    /**
+     *  Escape n bytes. The exact escaped size is checked once up front, so
+     *  either all bytes are written or none are.
+     */
+    bool pushBack( const uint8_t *src, int n )
+    {
+      if ( escapedSize(src, n) > capacityLeft() ) return false;
+      Check::update(src, n);
+      escape(src, n);
+      return true;
+    }
+
     bool pushBack( uint8_t c ) 
     {
+      uint8_t *buf = data();
       switch( c ) {
         case slip::kEnd:
           if ( capacityLeft() < 2 ) return false;
-          mBuffer[mPacketLength++] = slip::kEsc;
-          mBuffer[mPacketLength++] = slip::kEscEnd;
+          buf[mPacketLength++] = slip::kEsc;
+          buf[mPacketLength++] = slip::kEscEnd;
           break;
         case slip::kEsc:
           if ( capacityLeft() < 2 ) return false;
-          mBuffer[mPacketLength++] = slip::kEsc;
-          mBuffer[mPacketLength++] = slip::kEscEsc;
+          buf[mPacketLength++] = slip::kEsc;
+          buf[mPacketLength++] = slip::kEscEsc;
           break;
         default:
           if ( capacityLeft() == 0 ) return false;
-          mBuffer[mPacketLength++] = c;
+          buf[mPacketLength++] = c;
           break;
       }
+      Check::update(c);
       return true;
     }
+  protected:
+   // escape n bytes, the capacity has been checked.
+   void escape( const uint8_t *src, int n )
+   {
+      uint8_t *buf = data();
+      for (int i = 0; i < n; i++) {
+        uint8_t c = src[i];
+        if (c == slip::kEnd) {
+          buf[mPacketLength++] = slip::kEsc;
+          buf[mPacketLength++] = slip::kEscEnd;
+        } else if (c == slip::kEsc) {
+          buf[mPacketLength++] = slip::kEsc;
+          buf[mPacketLength++] = slip::kEscEsc;
+        } else {
+          buf[mPacketLength++] = c;
+        }
+      }
+   }
+
+   inline uint8_t *data() { return static_cast<Derived *>(this)->buffer(); }
+   inline Index_t capacity() const { return static_cast<const Derived *>(this)->capacity(); }
+
+   Index_t mPacketLength;
+  };
+
+
+/**
+ *  SLIP encoder on an external buffer.
+ */
+class Encoder : public BasicEncoder<Encoder, int> {
+  public:
+    Encoder(uint8_t *aBuffer, int aCapacity) : mBuffer(aBuffer), mCapacity(aCapacity)
+    {
+    }
+
+    inline uint8_t *buffer() { return mBuffer; }
+    inline int capacity() const { return mCapacity; }
+
   protected:
    uint8_t *mBuffer;
    int mCapacity;
-   int mPacketLength;
   };
+
+
+/**
+ *  SLIP encoder that owns a buffer of Capacity bytes.
+ */
+template <uint32_t Capacity, class Check = NoCheck>
+class StaticEncoder : public BasicEncoder<StaticEncoder<Capacity, Check>, typename IndexFor<Capacity>::type, Check> {
+  public:
+    static_assert(Capacity >= 2, "slip::StaticEncoder needs room for at least one escaped byte");
+    typedef typename IndexFor<Capacity>::type Index_t;
+
+    inline uint8_t *buffer() { return mBuffer; }
+    inline Index_t capacity() const { return Capacity; }
+
+  protected:
+   uint8_t mBuffer[Capacity];
+  };
+
+
+/**
+ *  Zero copy SLIP decoder. The caller fills the buffer directly, with read()
+ *  or DMA, and complete frames are unescaped in place. Unescaping only ever
+ *  shrinks the data, so no second buffer is needed.
+ *
+ *    int n = read(fd, decoder.tail(), decoder.space());
+ *    decoder.commit(n);
+ *    while (decoder.nextFrame(&frame, size)) handle(frame, size);
+ *
+ *  A frame returned by nextFrame() stays valid until the next call to tail().
+ *  With a Check, the trailer of every frame is verified over the unescaped
+ *  frame in one pass, and stripped.
+ */
+template <class Check = NoCheck>
+class BasicInPlaceDecoder : protected Check {
+ public:
+   BasicInPlaceDecoder(uint8_t *buffer, int capacity) : mBuffer(buffer), mCapacity(capacity), mHead(0), mFill(0), mErrors(0), mDiscard(false)
+    {
+    }
+
+    inline void clear() { mHead = 0; mFill = 0; mDiscard = false; }
+
+    /**
+     *  Where the next received bytes go. Moves a partially received frame to
+     *  the front of the buffer first, which invalidates returned frames.
+     */
+    uint8_t *tail()
+    {
+      if (mHead > 0) {
+        memmove(mBuffer, mBuffer + mHead, mFill - mHead);
+        mFill -= mHead;
+        mHead = 0;
+      }
+      return mBuffer + mFill;
+    }
+
+    inline int space() const { return mCapacity - mFill; }
+
+    /**
+     *  Account for n bytes written at tail(). When the buffer is full without
+     *  a complete frame, the frame is too large and is dropped up to its end.
+     */
+    void commit( int n )
+    {
+      mFill += n;
+      if (mFill == mCapacity && mHead == 0 && memchr(mBuffer, slip::kEnd, mFill) == NULL) {
+        if (!mDiscard) mErrors++;
+        mFill = 0;
+        mDiscard = true;
+      }
+    }
+
+    /**
+     *  Unescape the next complete frame in place.
+     *  @param frame set to the start of the frame.
+     *  @param size set to the size of the frame.
+     *  @return true when a frame was found. 
+     */
+    bool nextFrame( uint8_t **frame, int &size )
+    {
+      while (mHead < mFill) {
+        uint8_t *start = mBuffer + mHead;
+        uint8_t *end = (uint8_t *)memchr(start, slip::kEnd, mFill - mHead);
+        if (end == NULL) return false;
+        mHead = end - mBuffer + 1;
+        if (mDiscard) { mDiscard = false; continue; } // the rest of a dropped frame
+        if (end == start) continue; // ignore end with zero length
+
+        // the first escape, everything before it is already in place.
+        uint8_t *r = (uint8_t *)memchr(start, slip::kEsc, end - start);
+        uint8_t *w = r;
+        bool ok = true;
+        if (r != NULL) {
+          while (r < end) {
+            uint8_t c = *r++;
+            if (c == slip::kEsc) {
+              c = (r < end) ? *r++ : 0;
+              if (c == slip::kEscEnd) c = slip::kEnd;
+              else if (c == slip::kEscEsc) c = slip::kEsc;
+              else { ok = false; break; } // protocol violation.
+            }
+            *w++ = c;
+          }
+        } else {
+          w = end;
+        }
+        if (!ok) { mErrors++; continue; }
+        size = w - start;
+        if (Check::kSize > 0) {
+          if (size <= (int)Check::kSize) { Check::fail(); continue; }
+          Check::reset();
+          Check::update(start, size);
+          if (!Check::check()) continue;
+          size -= Check::kSize;
+        }
+        *frame = start;
+        return true;
+      }
+      return false;
+    }
+
+    /**
+     *  @return the number of frames dropped for a bad escape or for being
+     *  larger than the buffer.
+     */
+    inline uint32_t errors() const { return mErrors; }
+    /**
+     *  @return the number of frames dropped because the check failed.
+     */
+    inline uint32_t badFrames() const { return Check::failures(); }
+
+ protected:
+   uint8_t *mBuffer;
+   int mCapacity;
+   int mHead; // start of the first frame not returned yet
+   int mFill; // bytes in the buffer
+   uint32_t mErrors;
+   bool mDiscard; // dropping an oversized frame
+};
+
+typedef BasicInPlaceDecoder<NoCheck> InPlaceDecoder;
 } // end namespace slip
 } // end namespace fou
 
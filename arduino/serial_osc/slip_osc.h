@@ -0,0 +1,238 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#ifndef FSLIP_OSC_H_
+#define FSLIP_OSC_H_
+
+#include "stdint.h"
+
+#include "slip.h"
+#include "fosc.h"
+
+namespace fou {
+namespace slip {
+
+/**
+ *  SLIP decoder that parses the OSC message while its bytes are unescaped.
+ *  When the end of the frame arrives, the address, the type tags and the
+ *  argument offsets are known and the message is validated, so a
+ *  MessageIterator can be set up without scanning the packet again.
+ *  Bundles are recognized but not parsed. With a Check, frames are verified
+ *  and the trailer is stripped before the message is accepted.
+ */
+template <uint32_t Capacity, class Check = NoCheck>
+class MessageDecoder : public BasicDecoder<MessageDecoder<Capacity, Check>, typename IndexFor<Capacity>::type, Check> {
+  friend class BasicDecoder<MessageDecoder<Capacity, Check>, typename IndexFor<Capacity>::type, Check>;
+ public:
+    static_assert(Capacity >= 8, "slip::MessageDecoder is too small for any message");
+    static_assert(Capacity <= 0xffff, "osc::MessageLayout_t offsets are 16 bit");
+    typedef typename IndexFor<Capacity>::type Index_t;
+
+    MessageDecoder() { frameReset(); }
+
+    inline uint8_t *buffer() { return mBuffer; }
+    inline Index_t capacity() const { return Capacity; }
+
+    /**
+     *  @return true when a complete and valid OSC message has been received.
+     */
+    inline bool hasMessage() const { return this->mReady && mState == kDone; }
+    /**
+     *  @return true when a complete frame starting with '#' has been received.
+     */
+    inline bool hasBundle() const { return this->mReady && mState == kBundle; }
+    /**
+     *  The offsets of the received message. Valid when hasMessage() is true.
+     */
+    inline const osc::MessageLayout_t &layout() const { return mLayout; }
+
+    /**
+     *  Set up a message iterator for the received message.
+     *  @param mi the message iterator.
+     *  @return true on success, false when there is no valid message.
+     */
+    template <typename Size_t>
+    bool message(osc::BasicMessageIterator<Size_t> &mi) {
+      if (!hasMessage()) return false;
+      return mi.decode((char *)mBuffer, mLayout);
+    }
+
+ protected:
+    enum State {
+      kStart,     // first byte, '/' or '#'
+      kAddress,   // address string up to '\0'
+      kPad,       // zero padding up to the next 4 byte boundary
+      kComma,     // ',' that starts the type tags
+      kTypes,     // type tags up to '\0'
+      kFixed,     // fixed size argument
+      kString,    // string argument up to '\0'
+      kBlobSize,  // 32 bit blob size
+      kBlob,      // blob data, kPad checks the padding after it
+      kArg,       // not a state, kPad continues with the next argument
+      kDone,      // all arguments read, only the check trailer may follow
+      kBundle,    // '#', the rest is not parsed
+      kInvalid
+    };
+
+    void frameReset() {
+      mState = kStart;
+      mArg = 0;
+      mLayout.types_size = 0;
+      mLayout.size = 0;
+    }
+
+    inline void frameError() { mState = kInvalid; }
+
+    // called after the trailer has been verified and stripped.
+    void frameEnd() {
+      if (mState != kDone) return;
+      if (mRemaining != Check::kSize) mState = kInvalid;
+      else mLayout.size = this->mPacketLength;
+    }
+
+    // c is stored at offset mPacketLength.
+    void frameByte(uint8_t c) {
+      Index_t at = this->mPacketLength;
+      switch (mState) {
+        case kStart:
+          if (c == '/') mState = kAddress;
+          else if (c == '#') mState = kBundle;
+          else mState = kInvalid;
+          break;
+        case kAddress:
+          if (c == 0) pad(at, kComma);
+          break;
+        case kPad:
+          if (c != 0) mState = kInvalid;
+          else if ((at & 3) == 3) {
+            if (mNext == kArg) nextArg(at + 1);
+            else mState = mNext;
+          }
+          break;
+        case kComma:
+          if (c != ',') { mState = kInvalid; break; }
+          mLayout.types = at + 1;
+          mState = kTypes;
+          break;
+        case kTypes:
+          if (c == 0) { 
+            mLayout.args = (at + 4) & ~3;
+            pad(at, kArg);
+          } else if (mLayout.types_size == FOSC_MAX_ARGS) {
+            mState = kInvalid;
+          } else {
+            mLayout.types_size++;
+          }
+          break;
+        case kFixed:
+          if (--mRemaining == 0) { mArg++; nextArg(at + 1); }
+          break;
+        case kString:
+          if (c == 0) { mArg++; pad(at, kArg); }
+          break;
+        case kBlobSize:
+          mRemaining = (mRemaining << 8) | c;
+          if ((at & 3) != 3) break;
+          if (mRemaining > Capacity) { mState = kInvalid; break; }
+          if (mRemaining == 0) { mArg++; nextArg(at + 1); }
+          else mState = kBlob;
+          break;
+        case kBlob:
+          if (--mRemaining == 0) { mArg++; pad(at, kArg); }
+          break;
+        case kDone:
+          if (++mRemaining > Check::kSize) mState = kInvalid;
+          break;
+        case kInvalid:
+          break;
+        case kBundle:
+          break;
+      }
+    }
+
+    // after the '\0' at offset at, skip padding and continue with next.
+    inline void pad(Index_t at, uint8_t next) {
+      if ((at & 3) == 3) {
+        if (next == kArg) nextArg(at + 1);
+        else mState = next;
+      } else {
+        mState = kPad;
+        mNext = next;
+      }
+    }
+
+    // start the argument mArg at offset at. Arguments without data are
+    // consumed right away.
+    void nextArg(Index_t at) {
+      for (;;) {
+        if (mArg == mLayout.types_size) { mState = kDone; mRemaining = 0; return; }
+        mLayout.arg[mArg] = at;
+        switch (mBuffer[mLayout.types + mArg]) {
+          case osc::kFOSC_INT32:
+          case osc::kFOSC_FLOAT:
+          case osc::kFOSC_CHAR:
+          case osc::kFOSC_MIDI:
+            mState = kFixed; mRemaining = 4;
+            return;
+          case osc::kFOSC_INT64:
+          case osc::kFOSC_TIMETAG:
+          case osc::kFOSC_DOUBLE:
+            mState = kFixed; mRemaining = 8;
+            return;
+          case osc::kFOSC_STRING:
+          case osc::kFOSC_SYMBOL:
+            mState = kString;
+            return;
+          case osc::kFOSC_BLOB:
+            mState = kBlobSize; mRemaining = 0;
+            return;
+          case osc::kFOSC_TRUE:
+          case osc::kFOSC_FALSE:
+          case osc::kFOSC_NIL:
+          case osc::kFOSC_INFINITUM:
+            mArg++;
+            break;
+          default:
+            mState = kInvalid;
+            return;
+        }
+      }
+    }
+
+    uint8_t mBuffer[Capacity];
+    uint8_t mState;
+    uint8_t mNext;   // state after kPad
+    uint8_t mArg;    // argument being parsed
+    uint32_t mRemaining;
+    osc::MessageLayout_t mLayout;
+};
+
+} // end namespace slip
+} // end namespace fou
+
+#endif
@@ -0,0 +1,347 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#include "bundle_pool.h"
+#include "fosc_endian.h"
+
+#include <string.h>
+#include <unordered_map>
+
+using namespace fou::gateway;
+using namespace fou::osc;
+
+static const char kBundleHeader[8] = {'#', 'b', 'u', 'n', 'd', 'l', 'e', 0};
+
+static bool index_bundle(const char *buffer, uint32_t base, uint32_t size,
+                         std::vector<Element_t> &elements, int depth) {
+  const char *bundle = buffer + base;
+  if (depth <= 0 || size < 16 || (size & 3) != 0) return false;
+  if (memcmp(bundle, kBundleHeader, 8) != 0) return false;
+
+  uint32_t o = 16; // header and time tag
+  while (o < size) {
+    if (size - o < 4) return false;
+    uint32_t length = endian::load32((const uint8_t *)bundle + o);
+    o += 4;
+    if (length > size - o || (length & 3) != 0 || length == 0) return false;
+    if (bundle[o] == '#') {
+      if (!index_bundle(buffer, base + o, length, elements, depth - 1)) return false;
+    } else {
+      Element_t e = { base + o, length };
+      elements.push_back(e);
+    }
+    o += length;
+  }
+  return true;
+}
+
+bool fou::gateway::indexBundle(const char *buffer, int size, std::vector<Element_t> &elements, int depth) {
+  if (size < 0) return false;
+  return index_bundle(buffer, 0, (uint32_t)size, elements, depth);
+}
+
+/**
+ *  FNV-1a of the address, bounded by the element. Only used to group
+ *  messages, a collision merely orders two addresses together.
+ */
+static uint32_t address_hash(const char *p, uint32_t size) {
+  uint32_t h = 2166136261u;
+  for (uint32_t i = 0; i < size && p[i] != 0; i++) {
+    h = (h ^ (uint8_t)p[i]) * 16777619u;
+  }
+  return h;
+}
+
+BundlePool::BundlePool(MessageHandler handler, void *context, int threads, Ordering_t ordering) :
+  handler_(handler), context_(context), ordering_(ordering), grain_(16), buffer_(NULL),
+  remaining_(0), pushes_(0), state_(NULL), turn_(NULL), state_capacity_(0), turn_capacity_(0),
+  generation_(0), busy_(0), stop_(false) {
+  if (threads <= 0) threads = std::thread::hardware_concurrency();
+  if (threads <= 0) threads = 1;
+  for (int i = 0; i < threads; i++) {
+    workers_.push_back(new Worker());
+    workers_[i]->messages = 0;
+    workers_[i]->dropped = 0;
+    workers_[i]->steals = 0;
+  }
+  // worker 0 is the thread that calls dispatch().
+  for (int i = 1; i < threads; i++) {
+    workers_[i]->thread = std::thread(&BundlePool::run, this, i);
+  }
+  reset_stats();
+}
+
+BundlePool::~BundlePool() {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (int i = 0; i < (int)workers_.size(); i++) {
+    if (workers_[i]->thread.joinable()) workers_[i]->thread.join();
+    delete workers_[i];
+  }
+  delete[] state_;
+  delete[] turn_;
+}
+
+void BundlePool::reset_stats() {
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+void BundlePool::run(int worker) {
+  uint64_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(lock_);
+      while (!stop_ && generation_ == seen) wake_.wait(lock);
+      if (stop_) return;
+      seen = generation_;
+      busy_++;
+    }
+    work(worker);
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      busy_--;
+    }
+    idle_.notify_all();
+  }
+}
+
+void BundlePool::work(int worker) {
+  Range range;
+  while (remaining_.load() > 0) {
+    uint64_t seen = pushes_.load();
+    if (pop(worker, range) || steal(worker, range)) {
+      process(worker, range);
+      continue;
+    }
+    // the rest is being processed: park until a range is pushed, or the
+    // bundle is done.
+    std::unique_lock<std::mutex> lock(park_lock_);
+    while (remaining_.load() > 0 && pushes_.load() == seen) parked_.wait(lock);
+  }
+}
+
+void BundlePool::push(int worker, const Range &range) {
+  Worker *w = workers_[worker];
+  {
+    std::lock_guard<std::mutex> lock(w->lock);
+    w->ranges.push_back(range);
+  }
+  // counted under park_lock_, so a worker about to park cannot miss it.
+  {
+    std::lock_guard<std::mutex> lock(park_lock_);
+    pushes_++;
+  }
+  parked_.notify_all();
+}
+
+bool BundlePool::pop(int worker, Range &range) {
+  Worker *w = workers_[worker];
+  std::lock_guard<std::mutex> lock(w->lock);
+  if (w->ranges.empty()) return false;
+  range = w->ranges.back();
+  w->ranges.pop_back();
+  return true;
+}
+
+bool BundlePool::steal(int worker, Range &range) {
+  int n = (int)workers_.size();
+  for (int i = 1; i < n; i++) {
+    Worker *victim = workers_[(worker + i) % n];
+    std::lock_guard<std::mutex> lock(victim->lock);
+    if (!victim->ranges.empty()) {
+      // the oldest range is the largest one.
+      range = victim->ranges.front();
+      victim->ranges.pop_front();
+      workers_[worker]->steals++;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool BundlePool::decode(int worker, uint32_t element, MessageIterator &mi) {
+  const Element_t &e = elements_[element];
+  MessageLayout_t layout;
+  if (validateMessage(buffer_ + e.offset, e.size, &layout) != kFOSC_VALID) {
+    workers_[worker]->dropped++;
+    return false;
+  }
+  return mi.decode(buffer_ + e.offset, layout);
+}
+
+void BundlePool::process(int worker, Range range) {
+  // keep the first half, leave the second half to be stolen.
+  while (range.split && (int)(range.end - range.begin) > grain_) {
+    Range rest = { range.begin + (range.end - range.begin) / 2, range.end, true };
+    push(worker, rest);
+    range.end = rest.begin;
+  }
+
+  Worker *w = workers_[worker];
+  for (uint32_t i = range.begin; i < range.end; i++) {
+    uint32_t element = order_[i];
+    if (ordering_ == kORDER_SEQUENCED) {
+      valid_[element] = decode(worker, element, decoded_[element]);
+      state_[element].store(1);
+      release(worker, chain_[element]);
+    } else {
+      MessageIterator mi;
+      if (decode(worker, element, mi)) {
+        handler_(mi, worker, context_);
+        w->messages++;
+      }
+    }
+  }
+  uint32_t count = range.end - range.begin;
+  if ((uint32_t)remaining_.fetch_sub(count) == count) {
+    std::lock_guard<std::mutex> lock(park_lock_);
+    parked_.notify_all();
+  }
+}
+
+/**
+ *  Hand the decoded messages at the turn of a chain to the handler. Whoever
+ *  decodes the message at the turn, or finds it decoded after moving the 
+ *  turn, handles it. The compare and exchange makes sure only one does.
+ */
+void BundlePool::release(int worker, int chain) {
+  for (;;) {
+    int element = turn_[chain].load();
+    if (element < 0) return;
+    uint8_t decoded = 1;
+    if (!state_[element].compare_exchange_strong(decoded, 2)) return;
+    if (valid_[element]) {
+      handler_(decoded_[element], worker, context_);
+      workers_[worker]->messages++;
+    }
+    turn_[chain].store(next_[element]);
+  }
+}
+
+int BundlePool::dispatch(char *buffer, int size) {
+  // one bundle at a time: worker 0 is the caller, and is not counted in busy_.
+  std::lock_guard<std::mutex> serial(dispatch_lock_);
+  std::unique_lock<std::mutex> lock(lock_);
+  while (busy_ > 0) idle_.wait(lock);
+
+  elements_.clear();
+  if (!indexBundle(buffer, size, elements_)) return -1;
+  int n = (int)elements_.size();
+  int threads = (int)workers_.size();
+  stats_.bundles++;
+  if (n == 0) return 0;
+
+  buffer_ = buffer;
+  order_.resize(n);
+  if (ordering_ == kORDER_PER_ADDRESS) {
+    // a counting sort of the messages into groups, in bundle order within 
+    // a group. Every group is handled by one worker.
+    int groups = threads * 4;
+    std::vector<int> group(n);
+    std::vector<uint32_t> start(groups + 1, 0);
+    for (int i = 0; i < n; i++) {
+      group[i] = address_hash(buffer + elements_[i].offset, elements_[i].size) % groups;
+      start[group[i] + 1]++;
+    }
+    for (int g = 0; g < groups; g++) start[g + 1] += start[g];
+    std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+    for (int i = 0; i < n; i++) order_[fill[group[i]]++] = i;
+    for (int g = 0, w = 0; g < groups; g++) {
+      if (start[g] == start[g + 1]) continue;
+      Range range = { start[g], start[g + 1], false };
+      workers_[w++ % threads]->ranges.push_back(range);
+    }
+  } else {
+    for (int i = 0; i < n; i++) order_[i] = i;
+    for (int w = 0; w < threads; w++) {
+      Range range = { (uint32_t)((int64_t)n * w / threads),
+                      (uint32_t)((int64_t)n * (w + 1) / threads), true };
+      if (range.begin < range.end) workers_[w]->ranges.push_back(range);
+    }
+  }
+
+  if (ordering_ == kORDER_SEQUENCED) {
+    if (n > state_capacity_) {
+      delete[] state_;
+      state_ = new std::atomic<uint8_t>[n];
+      state_capacity_ = n;
+    }
+    chain_.resize(n);
+    next_.assign(n, -1);
+    decoded_.resize(n);
+    valid_.assign(n, 0);
+    std::unordered_map<uint32_t, int> chains;
+    std::vector<int> first, last;
+    for (int i = 0; i < n; i++) {
+      state_[i].store(0, std::memory_order_relaxed);
+      uint32_t h = address_hash(buffer + elements_[i].offset, elements_[i].size);
+      std::unordered_map<uint32_t, int>::iterator it = chains.find(h);
+      if (it == chains.end()) {
+        chain_[i] = (int)first.size();
+        chains[h] = chain_[i];
+        first.push_back(i);
+        last.push_back(i);
+      } else {
+        chain_[i] = it->second;
+        next_[last[it->second]] = i;
+        last[it->second] = i;
+      }
+    }
+    int count = (int)first.size();
+    if (count > turn_capacity_) {
+      delete[] turn_;
+      turn_ = new std::atomic<int>[count];
+      turn_capacity_ = count;
+    }
+    for (int c = 0; c < count; c++) turn_[c].store(first[c], std::memory_order_relaxed);
+  }
+
+  remaining_.store(n);
+  generation_++;
+  lock.unlock();
+  wake_.notify_all();
+
+  work(0);
+
+  lock.lock();
+  while (busy_ > 0) idle_.wait(lock);
+  int handled = 0;
+  for (int w = 0; w < threads; w++) {
+    handled += workers_[w]->messages;
+    stats_.messages += workers_[w]->messages;
+    stats_.dropped += workers_[w]->dropped;
+    stats_.steals += workers_[w]->steals;
+    workers_[w]->messages = 0;
+    workers_[w]->dropped = 0;
+    workers_[w]->steals = 0;
+  }
+  return handled;
+}
@@ -0,0 +1,201 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#ifndef FOU_BUNDLE_POOL_H_
+#define FOU_BUNDLE_POOL_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "fosc.h"
+#include "fosc_validate.h"
+
+namespace fou {
+namespace gateway {
+
+/**
+ *  A message within a bundle.
+ */
+typedef struct {
+  uint32_t offset;  /** from the start of the outer bundle */
+  uint32_t size;
+} Element_t;
+
+/**
+ *  Find the messages of a bundle from the element sizes alone, descending
+ *  into nested bundles. Nothing but the size fields and the first byte of
+ *  every element is read.
+ *  @param elements the messages are appended to this.
+ *  @return false for a bundle that is malformed or nested too deep.
+ */
+bool indexBundle(const char *buffer, int size, std::vector<Element_t> &elements,
+                 int depth = FOSC_MAX_BUNDLE_DEPTH);
+
+typedef enum {
+  kORDER_NONE,        /** messages are handled in any order */
+  kORDER_PER_ADDRESS, /** messages to one address are decoded and handled by
+                          one worker, in bundle order */
+  kORDER_SEQUENCED    /** messages are decoded in any order, but handled in
+                          bundle order per address */
+} Ordering_t;
+
+/**
+ *  Counters of a BundlePool.
+ */
+typedef struct {
+  uint64_t bundles;   /** bundles dispatched */
+  uint64_t messages;  /** messages handled */
+  uint64_t dropped;   /** messages that failed validation */
+  uint64_t steals;    /** ranges taken from another worker */
+} PoolStats_t;
+
+/**
+ *  Decodes and dispatches the messages of large bundles on a pool of worker
+ *  threads. A bundle is indexed first, which only follows the size fields,
+ *  then ranges of messages are spread over the workers. Every worker has its
+ *  own queue of ranges and splits a large range in halves, leaving one half
+ *  for idle workers to steal. Every message is validated before it is
+ *  decoded, so untrusted bundles are safe.
+ *
+ *  The handler is called concurrently from several workers. Messages to
+ *  different addresses can always be handled at the same time, the ordering
+ *  decides what holds for messages to one address. Addresses are grouped by
+ *  a hash, so unrelated addresses may occasionally share the ordering of one.
+ *
+ *  dispatch() blocks, and the calling thread works along as worker 0.
+ *  Concurrent calls are serialized, one bundle is dispatched at a time.
+ *  Workers that run out of work sleep until there is more.
+ */
+class BundlePool {
+public:
+  /**
+   *  Called for every valid message. The message is valid during the call only.
+   *  @param worker the worker, from 0 to threads() - 1, for per thread state.
+   */
+  typedef void (*MessageHandler)(osc::MessageIterator &mi, int worker, void *context);
+
+  /**
+   *  Constructor.
+   *  @param handler called for every message.
+   *  @param context passed to the handler.
+   *  @param threads the number of workers, the calling thread included. 0 
+   *         uses one per hardware thread.
+   *  @param ordering see Ordering_t.
+   */
+  BundlePool(MessageHandler handler, void *context, int threads = 0,
+             Ordering_t ordering = kORDER_NONE);
+  ~BundlePool();
+
+  /**
+   *  Decode and dispatch all messages of a bundle.
+   *  @return the number of messages handled, or -1 for a malformed bundle, 
+   *  in which case nothing is handled.
+   */
+  int dispatch(char *buffer, int size);
+
+  inline void set_ordering(Ordering_t ordering) { ordering_ = ordering; };
+  inline Ordering_t ordering() const { return ordering_; };
+  /**
+   *  Ranges of fewer messages than this are not split any further.
+   */
+  inline void set_grain(int grain) { grain_ = grain > 0 ? grain : 1; };
+  inline int threads() const { return (int)workers_.size(); };
+  inline const PoolStats_t &stats() const { return stats_; };
+  void reset_stats();
+
+private:
+  struct Range {
+    uint32_t begin;
+    uint32_t end;
+    bool split;    // may be split, false for the groups of kORDER_PER_ADDRESS
+  };
+  struct Worker {
+    std::mutex lock;
+    std::deque<Range> ranges;
+    std::thread thread;
+    uint64_t messages;
+    uint64_t dropped;
+    uint64_t steals;
+  };
+
+  void run(int worker);
+  void work(int worker);
+  bool pop(int worker, Range &range);
+  bool steal(int worker, Range &range);
+  void push(int worker, const Range &range);
+  void process(int worker, Range range);
+  bool decode(int worker, uint32_t element, osc::MessageIterator &mi);
+  void release(int worker, int chain);
+
+  BundlePool(const BundlePool &);
+  BundlePool &operator=(const BundlePool &);
+
+  MessageHandler handler_;
+  void *context_;
+  Ordering_t ordering_;
+  int grain_;
+  std::vector<Worker *> workers_;
+
+  // the bundle being dispatched.
+  char *buffer_;
+  std::vector<Element_t> elements_;
+  std::vector<uint32_t> order_;     // element of every position
+  std::atomic<int> remaining_;      // messages not yet processed
+  std::atomic<uint64_t> pushes_;    // ranges pushed, wakes parked workers
+  std::mutex park_lock_;
+  std::condition_variable parked_;
+
+  // kORDER_SEQUENCED: messages to one address form a chain, the turn of a
+  // chain is the next message to hand to the handler.
+  std::vector<int> chain_;          // chain of every element
+  std::vector<int> next_;           // next element in the chain, or -1
+  std::vector<osc::MessageIterator> decoded_;
+  std::vector<uint8_t> valid_;
+  std::atomic<uint8_t> *state_;     // 0 pending, 1 decoded, 2 handled
+  std::atomic<int> *turn_;
+  int state_capacity_;
+  int turn_capacity_;
+
+  std::mutex dispatch_lock_;
+  std::mutex lock_;
+  std::condition_variable wake_;
+  std::condition_variable idle_;
+  uint64_t generation_;
+  int busy_;
+  bool stop_;
+  PoolStats_t stats_;
+};
+
+} } // end namespace fou / gateway
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+/*
+ *  Writes a seed corpus for the fuzz targets in fuzz_targets.cpp, one file
+ *  per sample, in DIR/message, DIR/bundle and DIR/slip.
+ *
+ *    g++ -O2 -I ../arduino/serial_osc corpus_gen.cpp osc_corpus.cpp \
+ *        ../arduino/serial_osc/fosc.cpp ../arduino/serial_osc/fosc_validate.cpp \
+ *        -o corpus_gen
+ *
+ *    corpus_gen DIR [--count N] [--seed N]
+ *
+ *  The same seed writes the same corpus.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include "osc_corpus.h"
+
+using namespace fou;
+
+static bool make_dir(const std::string &path) {
+  return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+int main(int argc, char **argv) {
+  const char *dir = NULL;
+  int count = 3000;
+  uint64_t seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+      count = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = strtoull(argv[++i], NULL, 0);
+    } else if (argv[i][0] != '-' && dir == NULL) {
+      dir = argv[i];
+    } else {
+      dir = NULL;
+      break;
+    }
+  }
+  if (dir == NULL) {
+    fprintf(stderr, "usage: %s DIR [--count N] [--seed N]\n", argv[0]);
+    return 2;
+  }
+
+  static const char *kinds[] = { "message", "bundle", "slip" };
+  if (!make_dir(dir)) {
+    perror(dir);
+    return 1;
+  }
+  for (int k = 0; k < 3; k++) {
+    if (!make_dir(std::string(dir) + "/" + kinds[k])) {
+      perror(kinds[k]);
+      return 1;
+    }
+  }
+
+  corpus::Generator generator(seed);
+  std::vector<corpus::Sample_t> samples;
+  generator.generate(count, samples);
+  for (size_t i = 0; i < samples.size(); i++) {
+    const corpus::Sample_t &s = samples[i];
+    char name[64];
+    snprintf(name, sizeof(name), "/%05d-%s", (int)i, s.valid ? "valid" : "adversarial");
+    std::string path = std::string(dir) + "/" + kinds[s.kind] + name;
+    FILE *f = fopen(path.c_str(), "wb");
+    if (f == NULL) {
+      perror(path.c_str());
+      return 1;
+    }
+    if (!s.data.empty()) fwrite(&s.data[0], 1, s.data.size(), f);
+    fclose(f);
+  }
+  printf("%d samples in %s\n", (int)samples.size(), dir);
+  return 0;
+}
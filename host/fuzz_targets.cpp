@@ -0,0 +1,179 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+/*
+ *  libFuzzer targets for the parsers. One target is built at a time:
+ *
+ *    clang++ -g -O1 -fsanitize=fuzzer,address,undefined -DFOSC_FUZZ_MESSAGE \
+ *        -I ../arduino/serial_osc fuzz_targets.cpp ../arduino/serial_osc/fosc.cpp \
+ *        ../arduino/serial_osc/fosc_validate.cpp osc_corpus.cpp -o fuzz_message
+ *    ./corpus_gen corpus
+ *    ./fuzz_message corpus/message
+ *
+ *  with FOSC_FUZZ_MESSAGE, FOSC_FUZZ_BUNDLE or FOSC_FUZZ_SLIP, the last one
+ *  also needs ../arduino/serial_osc/crc.cpp. Without
+ *  libFuzzer, e.g. with g++, add -DFOSC_FUZZ_STANDALONE to get a main() that
+ *  runs the files given on the command line through the target once.
+ *
+ *  MessageIterator and BundleIterator trust their input, so the targets 
+ *  decode what validateMessage() and validateBundle() accept and read every
+ *  argument. A crash means the validator and the decoder disagree. The SLIP
+ *  decoders take any byte stream as it is.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "fosc.h"
+#include "fosc_validate.h"
+#include "slip.h"
+#include "crc.h"
+#include "osc_corpus.h"
+
+using namespace fou;
+
+#if defined(FOSC_FUZZ_MESSAGE)
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  // a copy, so reads past the input are caught.
+  std::vector<char> buf(data, data + size);
+  char *p = size > 0 ? &buf[0] : NULL;
+  osc::MessageLayout_t layout;
+  if (osc::validateMessage(p, size, &layout) != osc::kFOSC_VALID) return 0;
+
+  osc::MessageIterator mi;
+  if (mi.decode(p, size)) corpus::readArguments(mi);
+  if (mi.decode(p, layout)) corpus::readArguments(mi);
+
+  // round trip: encode the message into a bundle, get it back with
+  // BundleIterator::element() and compare.
+  if (!mi.decode(p, layout)) return 0;
+  std::vector<char> bundle(16 + 4 + size);
+  osc::BundleIterator encoder;
+  osc::MessageIterator copy;
+  if (!encoder.encode(&bundle[0], bundle.size()) ||
+      !encoder.begin_message(copy, mi.address(), mi.types()) ||
+      !corpus::copyArguments(mi, copy)) abort();
+  encoder.end_message(copy);
+
+  osc::BundleIterator decoder;
+  osc::MessageIterator element;
+  if (!decoder.decode(&bundle[0], encoder.size()) || !decoder.element(element)) abort();
+  if (decoder.element(element)) abort();
+  char *copied;
+  int copied_size;
+  if (!decoder.decode(&bundle[0], encoder.size()) || !decoder.element(&copied, copied_size)) abort();
+  if (copied_size != (int)size || memcmp(copied, p, size) != 0) abort();
+  return 0;
+}
+
+#elif defined(FOSC_FUZZ_BUNDLE)
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  std::vector<char> buf(data, data + size);
+  char *p = size > 0 ? &buf[0] : NULL;
+  if (osc::validateBundle(p, size) != osc::kFOSC_VALID) return 0;
+  corpus::readBundle(p, size);
+  return 0;
+}
+
+#elif defined(FOSC_FUZZ_SLIP)
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  static uint8_t buffer[256];
+  slip::Decoder decoder(buffer, sizeof(buffer));
+  for (size_t i = 0; i < size; i++) {
+    decoder.pushBack(data[i]);
+    if (decoder.hasPacket()) {
+      osc::validatePacket((const char *)buffer, decoder.getSize());
+      decoder.clear();
+    }
+  }
+
+  // the in place decoder, fed in chunks of varying size.
+  static uint8_t in_place[256];
+  slip::InPlaceDecoder ipd(in_place, sizeof(in_place));
+  size_t o = 0;
+  for (int chunk = 1; o < size; chunk = chunk * 3 % 97 + 1) {
+    int n = chunk;
+    if (n > ipd.space()) n = ipd.space();
+    if ((size_t)n > size - o) n = size - o;
+    memcpy(ipd.tail(), data + o, n);
+    ipd.commit(n);
+    o += n;
+    uint8_t *frame;
+    int frame_size;
+    while (ipd.nextFrame(&frame, frame_size)) {
+      osc::validatePacket((const char *)frame, frame_size);
+    }
+  }
+
+  // the input as one checked frame, followed by extra ends: a repeated end
+  // must neither strip the trailer again nor count a failure.
+  if (size == 0 || size > 256) return 0;
+  static slip::StaticEncoder<2 * 256 + 2 * 2 + 1, crc::Crc16> encoder;
+  static slip::StaticDecoder<256 + 2, crc::Crc16> checked;
+  encoder.clear();
+  checked.clear();
+  encoder.pushBack(data, size);
+  encoder.endPacket();
+  uint32_t bad = checked.badFrames();
+  for (int i = 0; i < encoder.getSize(); i++) checked.pushBack(encoder.getByte(i));
+  for (int i = 0; i < 3; i++) {
+    checked.pushBack(slip::kEnd);
+    if (!checked.hasPacket() || checked.getSize() != (int)size || checked.badFrames() != bad) abort();
+  }
+  return 0;
+}
+
+#else
+#error "define FOSC_FUZZ_MESSAGE, FOSC_FUZZ_BUNDLE or FOSC_FUZZ_SLIP"
+#endif
+
+#ifdef FOSC_FUZZ_STANDALONE
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    FILE *f = fopen(argv[i], "rb");
+    if (f == NULL) {
+      perror(argv[i]);
+      return 1;
+    }
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) data.insert(data.end(), chunk, chunk + n);
+    fclose(f);
+    LLVMFuzzerTestOneInput(data.empty() ? NULL : &data[0], data.size());
+  }
+  printf("%d inputs\n", argc - 1);
+  return 0;
+}
+#endif
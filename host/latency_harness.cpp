@@ -0,0 +1,475 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+/*
+ *  End to end latency harness. Measures the time from the call to 
+ *  MessageIterator::encode() until the handler runs on the receiving side,
+ *  including SLIP framing and the transport, over a pseudo terminal (a 
+ *  simulated serial line, paced at the baud rate) or over UDP loopback.
+ *
+ *    g++ -O2 -pthread -I ../arduino/serial_osc latency_harness.cpp \
+ *        ../arduino/serial_osc/fosc.cpp -lutil -o latency_harness
+ *
+ *    latency_harness --transport pty --baud 115200 --rate 500 --count 5000
+ *    latency_harness --transport udp --rate 10000 --mix fff,ifs,b --sweep
+ *
+ *  Options:
+ *    --transport pty|udp  transport, default pty.
+ *    --baud N             pty line rate used for pacing, 0 for none. Default 115200.
+ *                         UDP is never paced. A pty delivers every byte at
+ *                         once, so the baud rate limits the send rate but
+ *                         the time on the wire is not part of the latency.
+ *    --rate N             messages per second, default 1000.
+ *    --count N            messages per run, default 10000.
+ *    --mix a,b,...        type tag strings sent in turn, default "fff".
+ *    --sweep              double the rate until messages are dropped or the
+ *                         sender cannot keep up, and report the last rate
+ *                         that was sustained.
+ *    --max-p99 US         exit with 1 when p99 exceeds US microseconds.
+ *
+ *  Every message carries its sequence number as a leading int32, the send
+ *  time is kept on the sending side, which runs in the same process.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pty.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+#include "fosc.h"
+#include "slip.h"
+#include "slip_osc.h"
+
+using namespace fou;
+
+static inline uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// sleep for long waits, spin for the last two milliseconds: timer slack
+// would otherwise cap the send rate.
+static inline void sleep_until(uint64_t t) {
+  for (uint64_t now = now_ns(); now < t; now = now_ns()) {
+    if (t - now < 2000000ull) continue;
+    uint64_t wake = t - 1000000ull;
+    struct timespec ts;
+    ts.tv_sec = wake / 1000000000ull;
+    ts.tv_nsec = wake % 1000000000ull;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+  }
+}
+
+/**
+ *  Log linear latency histogram in nanoseconds: 64 linear sub buckets for
+ *  every power of two. The upper bound of the bucket a value falls in is at
+ *  most 1/64 of the value above it, check() verifies that.
+ */
+class Histogram {
+public:
+  Histogram() : counts_(kBuckets, 0), total_(0), max_(0) {};
+
+  void add(uint64_t ns) {
+    counts_[bucket(ns)]++;
+    total_++;
+    if (ns > max_) max_ = ns;
+  }
+  /**
+   *  @param q the quantile, 0..1.
+   *  @return the upper bound of the bucket that holds the quantile.
+   */
+  uint64_t quantile(double q) const {
+    if (total_ == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (total_ - 1)) + 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < kBuckets; b++) {
+      seen += counts_[b];
+      if (seen >= rank) return upper(b) < max_ ? upper(b) : max_;
+    }
+    return max_;
+  }
+  inline uint64_t count() const { return total_; };
+  inline uint64_t max() const { return max_; };
+
+  void print(FILE *out) const {
+    // coarse view, one line per power of two.
+    for (int e = 0; e < kBuckets / kSub; e++) {
+      uint64_t n = 0;
+      for (int s = 0; s < kSub; s++) n += counts_[e * kSub + s];
+      if (n == 0) continue;
+      fprintf(out, "  < %10.1f us  %10llu  %6.2f%%\n", upper(e * kSub + kSub - 1) / 1000.0,
+              (unsigned long long)n, 100.0 * n / total_);
+    }
+  }
+
+  /**
+   *  Round trip every value below 2^20 and the values around every power of
+   *  two above it through bucket() and upper().
+   *  @return true when upper(bucket(v)) >= v, within v / 64, for all of them.
+   */
+  static bool check() {
+    for (uint64_t v = 0; v < (1u << 20); v++) {
+      if (!round_trip(v)) return false;
+    }
+    for (int k = 20; k < 64; k++) {
+      uint64_t p = 1ull << k;
+      if (!round_trip(p - 1) || !round_trip(p) || !round_trip(p + 1) ||
+          !round_trip(p + (p >> 1) + 12345)) return false;
+    }
+    return round_trip(~0ull);
+  }
+
+private:
+  // bucket e * kSub + s holds the values whose top kSubBits + 1 bits are
+  // s | kSub, after a shift by e - 1. Bucket 0 holds the values below kSub.
+  enum { kSubBits = 6, kSub = 1 << kSubBits, kBuckets = (64 - kSubBits + 1) * kSub };
+
+  static inline int exponent(uint64_t v) {
+    return v < kSub ? 0 : 63 - __builtin_clzll(v) - kSubBits + 1;
+  }
+  static int bucket(uint64_t v) {
+    int e = exponent(v);
+    if (e == 0) return (int)v;
+    return e * kSub + (int)((v >> (e - 1)) & (kSub - 1));
+  }
+  static uint64_t upper(int b) {
+    int e = b / kSub;
+    uint64_t s = b % kSub;
+    if (e == 0) return s;
+    return ((s | kSub) << (e - 1)) + ((1ull << (e - 1)) - 1);
+  }
+  static inline bool round_trip(uint64_t v) {
+    uint64_t u = upper(bucket(v));
+    return u >= v && u - v <= v / kSub && bucket(u) == bucket(v);
+  }
+
+  std::vector<uint64_t> counts_;
+  uint64_t total_;
+  uint64_t max_;
+};
+
+typedef struct {
+  std::string transport;
+  int baud;
+  double rate;
+  int count;
+  std::vector<std::string> mix;
+  bool sweep;
+  double max_p99_us;
+} Options_t;
+
+typedef struct {
+  Histogram latency;
+  int sent;
+  int received;
+  int invalid;
+  double achieved_rate;
+} Result_t;
+
+static uint8_t blob_data[16] = {0xc0, 1, 2, 0xdb, 4, 5, 6, 7, 0xc0, 0xc0, 10, 11, 12, 0xdb, 14, 15};
+
+/**
+ *  Encode message seq of the mix. 
+ *  @return the size of the message.
+ */
+static int encode(char *buf, int capacity, const std::string &types, int32_t seq) {
+  osc::MessageIterator mi;
+  std::string tags = "i" + types;
+  mi.encode(buf, capacity, "/latency/probe", tags.c_str());
+  mi.append_i(seq);
+  for (size_t t = 0; t < types.size(); t++) {
+    switch (types[t]) {
+      case 'i': mi.append_i(seq); break;
+      case 'f': mi.append_f(seq * 0.5f); break;
+      case 's': mi.append_s("latency"); break;
+      case 'b': mi.append_b(blob_data, sizeof(blob_data)); break;
+    }
+  }
+  return mi.size();
+}
+
+/**
+ *  The handler on the receiving side.
+ */
+static void on_message(osc::MessageIterator &mi, const std::vector<uint64_t> &sent_at,
+                       const std::atomic<int> &sent, Result_t &result) {
+  int32_t seq;
+  uint64_t t = now_ns();
+  if (mi.args_size() < 1 || mi.arg_type() != osc::kFOSC_INT32) { result.invalid++; return; }
+  mi.i(seq);
+  // pairs with the release in run_sender(), sent_at[seq] is published.
+  if (seq < 0 || seq >= sent.load(std::memory_order_acquire)) { result.invalid++; return; }
+  result.latency.add(t - sent_at[seq]);
+  result.received++;
+}
+
+/**
+ *  Send count messages at the given rate. The sender never runs ahead of the
+ *  line: with pacing, a message can leave no earlier than the previous
+ *  message took to transmit. The send time of a message is published through
+ *  sent before the message is sent, so the receiver can read it.
+ */
+template <class Send>
+static void run_sender(const Options_t &o, double rate, int baud, std::vector<uint64_t> &sent_at,
+                       std::atomic<int> &sent, Result_t &result, Send send) {
+  char buf[1024];
+  uint64_t start = now_ns();
+  uint64_t interval = (uint64_t)(1e9 / rate);
+  uint64_t line_free = start;
+  for (int seq = 0; seq < o.count; seq++) {
+    uint64_t due = start + seq * interval;
+    if (line_free > due) due = line_free;
+    sleep_until(due);
+    uint64_t t = now_ns();
+    sent_at[seq] = t;
+    sent.store(seq + 1, std::memory_order_release);
+    int size = encode(buf, sizeof(buf), o.mix[seq % o.mix.size()], seq);
+    int wire = send(buf, size);
+    if (baud > 0 && wire > 0) line_free = t + (uint64_t)wire * 10 * 1000000000ull / baud;
+  }
+  double elapsed = (now_ns() - start) / 1e9;
+  result.achieved_rate = elapsed > 0 ? o.count / elapsed : 0;
+}
+
+static bool run_pty(const Options_t &o, double rate, Result_t &result) {
+  int master, slave;
+  if (openpty(&master, &slave, NULL, NULL, NULL) != 0) { perror("openpty"); return false; }
+  struct termios tio;
+  tcgetattr(slave, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(slave, TCSANOW, &tio);
+  tcgetattr(master, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(master, TCSANOW, &tio);
+
+  std::vector<uint64_t> sent_at(o.count, 0);
+  std::atomic<int> sent(0);
+  std::atomic<bool> done(false);
+
+  std::thread receiver([&]() {
+    slip::MessageDecoder<1024> decoder;
+    uint8_t buf[4096];
+    uint64_t deadline = 0;
+    while (result.received + result.invalid < o.count) {
+      if (done.load() && deadline == 0) deadline = now_ns() + 1000000000ull;
+      if (deadline && now_ns() > deadline) break;
+      struct timeval tv = {0, 100000};
+      fd_set set;
+      FD_ZERO(&set);
+      FD_SET(slave, &set);
+      if (select(slave + 1, &set, NULL, NULL, &tv) <= 0) continue;
+      ssize_t n = read(slave, buf, sizeof(buf));
+      for (ssize_t i = 0; i < n; i++) {
+        decoder.pushBack(buf[i]);
+        if (buf[i] != slip::kEnd || !decoder.hasPacket()) continue;
+        osc::MessageIterator mi;
+        if (decoder.message(mi)) on_message(mi, sent_at, sent, result);
+        else result.invalid++;
+      }
+    }
+  });
+
+  uint8_t wire[2 * 1024 + 1];
+  run_sender(o, rate, o.baud, sent_at, sent, result, [&](const char *msg, int size) -> int {
+    slip::Encoder encoder(wire, sizeof(wire));
+    encoder.pushBack((const uint8_t *)msg, size);
+    encoder.endPacket();
+    int off = 0;
+    while (off < encoder.getSize()) {
+      ssize_t n = write(master, wire + off, encoder.getSize() - off);
+      if (n < 0) { if (errno == EINTR || errno == EAGAIN) continue; return -1; }
+      off += n;
+    }
+    return encoder.getSize();
+  });
+  result.sent = sent.load();
+  done.store(true);
+  receiver.join();
+  close(master);
+  close(slave);
+  return true;
+}
+
+static bool run_udp(const Options_t &o, double rate, Result_t &result) {
+  int rx = socket(AF_INET, SOCK_DGRAM, 0);
+  int tx = socket(AF_INET, SOCK_DGRAM, 0);
+  if (rx < 0 || tx < 0) { perror("socket"); return false; }
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  socklen_t len = sizeof(addr);
+  if (bind(rx, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      getsockname(rx, (struct sockaddr *)&addr, &len) != 0) {
+    perror("bind");
+    return false;
+  }
+  struct timeval tv = {0, 100000};
+  setsockopt(rx, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  std::vector<uint64_t> sent_at(o.count, 0);
+  std::atomic<int> sent(0);
+  std::atomic<bool> done(false);
+
+  std::thread receiver([&]() {
+    char buf[2048];
+    uint64_t deadline = 0;
+    while (result.received + result.invalid < o.count) {
+      if (done.load() && deadline == 0) deadline = now_ns() + 1000000000ull;
+      if (deadline && now_ns() > deadline) break;
+      ssize_t n = recv(rx, buf, sizeof(buf), 0);
+      if (n <= 0) continue;
+      osc::MessageIterator mi;
+      if (mi.decode(buf, (int)n)) on_message(mi, sent_at, sent, result);
+      else result.invalid++;
+    }
+  });
+
+  run_sender(o, rate, 0, sent_at, sent, result, [&](const char *msg, int size) -> int {
+    ssize_t n = sendto(tx, msg, size, 0, (struct sockaddr *)&addr, sizeof(addr));
+    return n < 0 ? -1 : (int)n;
+  });
+  result.sent = sent.load();
+  done.store(true);
+  receiver.join();
+  close(rx);
+  close(tx);
+  return true;
+}
+
+static bool run(const Options_t &o, double rate, Result_t &result) {
+  result.sent = result.received = result.invalid = 0;
+  result.achieved_rate = 0;
+  if (o.transport == "udp") return run_udp(o, rate, result);
+  return run_pty(o, rate, result);
+}
+
+static void report(const Options_t &o, double rate, const Result_t &r) {
+  printf("%s rate %.0f/s (achieved %.0f/s), sent %d, received %d, dropped %d, invalid %d\n",
+         o.transport.c_str(), rate, r.achieved_rate, r.sent, r.received,
+         r.sent - r.received - r.invalid, r.invalid);
+  printf("  p50 %.1f us  p99 %.1f us  p99.9 %.1f us  max %.1f us\n",
+         r.latency.quantile(0.5) / 1000.0, r.latency.quantile(0.99) / 1000.0,
+         r.latency.quantile(0.999) / 1000.0, r.latency.max() / 1000.0);
+  if (o.transport == "pty" && o.baud > 0) {
+    printf("  note: --baud %d paces the sender only, the latency excludes wire time\n", o.baud);
+  }
+}
+
+// a rate is sustained when nothing is lost and the sender kept up.
+static inline bool sustained(double rate, const Result_t &r) {
+  return r.received == r.sent && r.invalid == 0 && r.achieved_rate >= 0.95 * rate;
+}
+
+static void usage() {
+  fprintf(stderr, "usage: latency_harness [--transport pty|udp] [--baud N] [--rate N] [--count N]\n"
+                  "                       [--mix fff,ifs,b] [--sweep] [--max-p99 US]\n");
+}
+
+int main(int argc, char **argv) {
+  Options_t o;
+  o.transport = "pty";
+  o.baud = 115200;
+  o.rate = 1000;
+  o.count = 10000;
+  o.sweep = false;
+  o.max_p99_us = 0;
+  std::string mix = "fff";
+
+  for (int a = 1; a < argc; a++) {
+    std::string arg = argv[a];
+    bool has_value = a + 1 < argc;
+    if (arg == "--transport" && has_value) o.transport = argv[++a];
+    else if (arg == "--baud" && has_value) o.baud = atoi(argv[++a]);
+    else if (arg == "--rate" && has_value) o.rate = atof(argv[++a]);
+    else if (arg == "--count" && has_value) o.count = atoi(argv[++a]);
+    else if (arg == "--mix" && has_value) mix = argv[++a];
+    else if (arg == "--max-p99" && has_value) o.max_p99_us = atof(argv[++a]);
+    else if (arg == "--sweep") o.sweep = true;
+    else { usage(); return 2; }
+  }
+  if ((o.transport != "pty" && o.transport != "udp") || o.rate <= 0 || o.count <= 0) {
+    usage();
+    return 2;
+  }
+  size_t start = 0;
+  while (start <= mix.size()) {
+    size_t end = mix.find(',', start);
+    if (end == std::string::npos) end = mix.size();
+    std::string types = mix.substr(start, end - start);
+    if (types.find_first_not_of("ifsb") != std::string::npos) {
+      fprintf(stderr, "unsupported type tags in mix: %s\n", types.c_str());
+      return 2;
+    }
+    o.mix.push_back(types);
+    start = end + 1;
+  }
+
+  if (!Histogram::check()) {
+    fprintf(stderr, "histogram buckets are inconsistent\n");
+    return 2;
+  }
+
+  Result_t result;
+  if (!run(o, o.rate, result)) return 2;
+  report(o, o.rate, result);
+  result.latency.print(stdout);
+
+  if (o.sweep) {
+    double rate = o.rate;
+    double best = sustained(rate, result) ? rate : 0;
+    while (best == rate) {
+      rate *= 2;
+      Result_t r;
+      if (!run(o, rate, r)) return 2;
+      report(o, rate, r);
+      if (sustained(rate, r)) best = rate;
+    }
+    printf("maximum sustained rate: %.0f/s\n", best);
+  }
+
+  if (o.max_p99_us > 0 && result.latency.quantile(0.99) / 1000.0 > o.max_p99_us) {
+    printf("FAIL: p99 above %.1f us\n", o.max_p99_us);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,255 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#include "osc_async.h"
+#include "fosc_validate.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <new>
+
+using namespace fou::gateway;
+
+/*
+ *  Frames are rounded up to size classes of kClassSize bytes. Larger frames
+ *  are rare and come straight from the heap.
+ */
+static const size_t kClassSize = 128;
+static const int kClasses = 32;
+
+namespace {
+struct FreeFrame {
+  FreeFrame *next;
+};
+thread_local FreeFrame *free_frames[kClasses];
+thread_local uint64_t heap_frames;
+}
+
+void *FramePool::allocate(size_t size) {
+  size_t c = (size + kClassSize - 1) / kClassSize;
+  if (c > 0 && c <= (size_t)kClasses) {
+    FreeFrame *f = free_frames[c - 1];
+    if (f != NULL) {
+      free_frames[c - 1] = f->next;
+      return f;
+    }
+    size = c * kClassSize;
+  }
+  heap_frames++;
+  return ::operator new(size);
+}
+
+void FramePool::release(void *p, size_t size) {
+  size_t c = (size + kClassSize - 1) / kClassSize;
+  if (c > 0 && c <= (size_t)kClasses) {
+    FreeFrame *f = (FreeFrame *)p;
+    f->next = free_frames[c - 1];
+    free_frames[c - 1] = f;
+    return;
+  }
+  ::operator delete(p);
+}
+
+uint64_t FramePool::heap_allocations() {
+  return heap_frames;
+}
+
+void Task::promise_type::Final::await_suspend(Handle h) noexcept {
+  Reactor *reactor = h.promise().reactor;
+  h.destroy();
+  if (reactor != NULL) reactor->tasks_--;
+}
+
+Reactor::Reactor() : tasks_(0) {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+}
+
+Reactor::~Reactor() {
+  if (epoll_fd_ >= 0) close(epoll_fd_);
+}
+
+void Reactor::spawn(Task task) {
+  Task::Handle h = task.release();
+  h.promise().reactor = this;
+  tasks_++;
+  ready_.push_back(h);
+}
+
+Reactor::Watch &Reactor::watch(int fd) {
+  if (fd >= (int)watches_.size()) {
+    Watch none = { NULL, NULL };
+    watches_.resize(fd + 1, none);
+  }
+  return watches_[fd];
+}
+
+bool Reactor::add(int fd) {
+  watch(fd);
+  int flags = fcntl(fd, F_GETFL);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) return false;
+  struct epoll_event ev;
+  ev.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+  ev.data.fd = fd;
+  // closing a descriptor drops it from epoll, so a reused number is added
+  // again.
+  return epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == 0 || errno == EEXIST;
+}
+
+void Reactor::remove(int fd) {
+  Watch &w = watch(fd);
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, NULL);
+  w.reader = NULL;
+  w.writer = NULL;
+}
+
+void Reactor::wait_readable(int fd, Waiter *waiter) {
+  watch(fd).reader = waiter;
+}
+
+void Reactor::wait_writable(int fd, Waiter *waiter) {
+  watch(fd).writer = waiter;
+}
+
+int Reactor::run_once(int timeout_ms) {
+  // resuming may spawn more, those run on the next pass.
+  while (!ready_.empty()) {
+    running_.swap(ready_);
+    for (size_t i = 0; i < running_.size(); i++) running_[i].resume();
+    running_.clear();
+  }
+  if (tasks_ == 0) return 0;
+
+  struct epoll_event events[64];
+  int n = epoll_wait(epoll_fd_, events, 64, timeout_ms);
+  if (n < 0) return errno == EINTR ? tasks_ : -1;
+  for (int i = 0; i < n; i++) {
+    int fd = events[i].data.fd;
+    uint32_t e = events[i].events;
+    bool error = (e & (EPOLLERR | EPOLLHUP)) != 0;
+    // a resumed Task may wait on the same descriptor again, so the watch is
+    // cleared before resuming.
+    Waiter *reader = watches_[fd].reader;
+    if (reader != NULL && (error || (e & (EPOLLIN | EPOLLRDHUP))) && reader->poll()) {
+      watches_[fd].reader = NULL;
+      reader->handle.resume();
+    }
+    Waiter *writer = watches_[fd].writer;
+    if (writer != NULL && (error || (e & EPOLLOUT)) && writer->poll()) {
+      watches_[fd].writer = NULL;
+      writer->handle.resume();
+    }
+  }
+  return tasks_;
+}
+
+void Reactor::run() {
+  while (run_once(-1) > 0) {}
+}
+
+Receiver::Receiver(Reactor &reactor, int fd, int buffer_size) :
+  reactor_(reactor), fd_(fd), buffer_(buffer_size), decoder_(&buffer_[0], buffer_size),
+  invalid_(0), closed_(false) {
+  reactor_.add(fd);
+}
+
+void Receiver::NextMessage::await_suspend(std::coroutine_handle<> h) {
+  handle = h;
+  receiver_.reactor_.wait_readable(receiver_.fd_, this);
+}
+
+/**
+ *  @return true when packet is set, false when the read would block.
+ */
+bool Receiver::next(Packet_t &packet) {
+  for (;;) {
+    uint8_t *frame;
+    int size;
+    while (decoder_.nextFrame(&frame, size)) {
+      if (osc::validatePacket((const char *)frame, size) == osc::kFOSC_VALID) {
+        packet.data = (char *)frame;
+        packet.size = size;
+        return true;
+      }
+      invalid_++;
+    }
+    if (!closed_) {
+      ssize_t n = read(fd_, decoder_.tail(), decoder_.space());
+      if (n > 0) {
+        decoder_.commit((int)n);
+        continue;
+      }
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0 && errno == EAGAIN) return false;
+      closed_ = true;
+    }
+    packet.data = NULL;
+    packet.size = -1;
+    return true;
+  }
+}
+
+Sender::Sender(Reactor &reactor, int fd, int buffer_size) :
+  reactor_(reactor), fd_(fd), buffer_(buffer_size), encoder_(&buffer_[0], buffer_size),
+  size_(0), sent_(0) {
+  reactor_.add(fd);
+}
+
+void Sender::Send::await_suspend(std::coroutine_handle<> h) {
+  handle = h;
+  sender_.reactor_.wait_writable(sender_.fd_, this);
+}
+
+Sender::Send Sender::send(const char *data, int size) {
+  encoder_.clear();
+  bool ok = encoder_.pushBack((const uint8_t *)data, size) && encoder_.endPacket();
+  size_ = ok ? encoder_.getSize() : 0;
+  sent_ = 0;
+  return Send(*this, ok);
+}
+
+/**
+ *  Write what is left of the frame.
+ *  @return false on an error.
+ */
+bool Sender::flush() {
+  while (sent_ < size_) {
+    ssize_t n = write(fd_, &buffer_[sent_], size_ - sent_);
+    if (n > 0) {
+      sent_ += n;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && errno == EAGAIN) {
+      return true;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,289 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#ifndef FOU_OSC_ASYNC_H_
+#define FOU_OSC_ASYNC_H_
+
+#if !defined(__cpp_impl_coroutine)
+#error "osc_async.h needs C++20 coroutines, build with -std=c++20"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <coroutine>
+#include <exception>
+#include <vector>
+
+#include "slip.h"
+
+namespace fou {
+namespace gateway {
+
+/**
+ *  Free lists of coroutine frames, by size class, for the calling thread.
+ *  A frame goes back to its list when the coroutine ends, so sessions that
+ *  come and go stop touching the heap once the lists are warm.
+ */
+class FramePool {
+public:
+  static void *allocate(size_t size);
+  static void release(void *p, size_t size);
+  /**
+   *  @return the number of frames taken from the heap on this thread.
+   */
+  static uint64_t heap_allocations();
+};
+
+class Reactor;
+
+/**
+ *  A coroutine that runs on a Reactor, e.g. one device session. It starts
+ *  once spawned and frees its frame when it returns.
+ *
+ *    Task session(Receiver &rx) {
+ *      for (;;) {
+ *        Packet_t p = co_await rx.next_message();
+ *        if (p.size < 0) co_return;
+ *        ...
+ *      }
+ *    }
+ */
+class Task {
+public:
+  struct promise_type;
+  typedef std::coroutine_handle<promise_type> Handle;
+
+  struct promise_type {
+    struct Final {
+      bool await_ready() noexcept { return false; }
+      void await_suspend(Handle h) noexcept;
+      void await_resume() noexcept {}
+    };
+
+    Task get_return_object() { return Task(Handle::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    Final final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+
+    static void *operator new(size_t size) { return FramePool::allocate(size); }
+    static void operator delete(void *p, size_t size) { FramePool::release(p, size); }
+
+    Reactor *reactor = nullptr;
+  };
+
+  Task(Task &&other) : handle_(other.handle_) { other.handle_ = nullptr; }
+  ~Task() { if (handle_) handle_.destroy(); }
+  Handle release() { Handle h = handle_; handle_ = nullptr; return h; }
+
+private:
+  explicit Task(Handle h) : handle_(h) {}
+  Task(const Task &);
+  Task &operator=(const Task &);
+
+  Handle handle_;
+};
+
+/**
+ *  An awaiter suspended on a descriptor. poll() is called when the
+ *  descriptor is ready and returns true once the awaiter can resume.
+ */
+class Waiter {
+public:
+  virtual bool poll() = 0;
+  std::coroutine_handle<> handle;
+
+protected:
+  ~Waiter() {}
+};
+
+/**
+ *  Runs Tasks on one thread, resuming them when their descriptors are ready.
+ *  Descriptors are registered edge triggered, and awaiters read or write
+ *  until the call would block before they suspend.
+ */
+class Reactor {
+public:
+  Reactor();
+  ~Reactor();
+
+  void spawn(Task task);
+
+  /**
+   *  Make a descriptor non blocking and watch it. Adding it again is a no-op,
+   *  a descriptor that is closed is dropped by itself.
+   *  @return true on success.
+   */
+  bool add(int fd);
+  /**
+   *  Stop watching a descriptor. No Task may be waiting on it.
+   */
+  void remove(int fd);
+
+  void wait_readable(int fd, Waiter *waiter);
+  void wait_writable(int fd, Waiter *waiter);
+
+  /**
+   *  Run spawned Tasks, then wait for descriptors once.
+   *  @param timeout_ms as for epoll_wait(), -1 waits forever.
+   *  @return the number of Tasks still alive, or -1 on error.
+   */
+  int run_once(int timeout_ms);
+  /**
+   *  Run until all Tasks have returned.
+   */
+  void run();
+
+  inline int tasks() const { return tasks_; };
+
+private:
+  friend struct Task::promise_type::Final;
+
+  struct Watch {
+    Waiter *reader;
+    Waiter *writer;
+  };
+
+  Watch &watch(int fd);
+
+  Reactor(const Reactor &);
+  Reactor &operator=(const Reactor &);
+
+  int epoll_fd_;
+  int tasks_;
+  std::vector<Watch> watches_;          // by descriptor
+  std::vector<std::coroutine_handle<> > ready_;
+  std::vector<std::coroutine_handle<> > running_;
+};
+
+/**
+ *  A received packet, valid until the next co_await on its Receiver.
+ */
+typedef struct {
+  char *data;
+  int size;   /** -1 at end of file or on an error */
+} Packet_t;
+
+/**
+ *  Receives SLIP framed OSC from a stream, e.g. a tty or a socket. Frames
+ *  are unescaped in place in the receive buffer and validated before they
+ *  are returned, invalid ones are skipped. One Task at a time may await it.
+ */
+class Receiver {
+public:
+  class NextMessage : public Waiter {
+  public:
+    explicit NextMessage(Receiver &receiver) : receiver_(receiver) {}
+    bool await_ready() { return receiver_.next(packet_); }
+    void await_suspend(std::coroutine_handle<> h);
+    Packet_t await_resume() { return packet_; }
+    bool poll() { return receiver_.next(packet_); }
+  private:
+    Receiver &receiver_;
+    Packet_t packet_;
+  };
+
+  /**
+   *  @param buffer_size the receive buffer, the largest frame that fits.
+   */
+  Receiver(Reactor &reactor, int fd, int buffer_size = 1024);
+
+  /**
+   *  co_await the next valid packet, a message or a bundle.
+   */
+  inline NextMessage next_message() { return NextMessage(*this); }
+
+  /**
+   *  @return the number of frames dropped by the SLIP decoder.
+   */
+  inline uint32_t errors() const { return decoder_.errors(); }
+  /**
+   *  @return the number of frames that were not valid OSC.
+   */
+  inline uint32_t invalid() const { return invalid_; }
+
+private:
+  bool next(Packet_t &packet);
+
+  Reactor &reactor_;
+  int fd_;
+  std::vector<uint8_t> buffer_;
+  slip::InPlaceDecoder decoder_;
+  uint32_t invalid_;
+  bool closed_;
+};
+
+/**
+ *  Sends OSC packets SLIP framed over a stream. A packet is escaped into the
+ *  send buffer and written. co_await completes when the whole frame is
+ *  written. One Task at a time may await it.
+ */
+class Sender {
+public:
+  class Send : public Waiter {
+  public:
+    Send(Sender &sender, bool ok) : sender_(sender), ok_(ok) {}
+    bool await_ready() { return !ok_ || poll(); }
+    void await_suspend(std::coroutine_handle<> h);
+    /**
+     *  @return true when the frame was written.
+     */
+    bool await_resume() { return ok_; }
+    bool poll() { ok_ = sender_.flush(); return !ok_ || sender_.done(); }
+  private:
+    Sender &sender_;
+    bool ok_;
+  };
+
+  /**
+   *  @param buffer_size the send buffer, the largest escaped frame.
+   */
+  Sender(Reactor &reactor, int fd, int buffer_size = 1024);
+
+  /**
+   *  co_await sending a packet.
+   */
+  Send send(const char *data, int size);
+  template <class Message>
+  inline Send send(Message &msg) { return send(msg.data(), msg.size()); }
+
+private:
+  bool flush();
+  inline bool done() const { return sent_ == size_; }
+
+  Reactor &reactor_;
+  int fd_;
+  std::vector<uint8_t> buffer_;
+  slip::Encoder encoder_;
+  int size_;
+  int sent_;
+};
+
+} } // end namespace fou / gateway
+
+#endif
@@ -0,0 +1,328 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#include "osc_corpus.h"
+#include "fosc_endian.h"
+#include "fosc_validate.h"
+#include "slip.h"
+
+#include <string.h>
+
+using namespace fou;
+using namespace fou::corpus;
+
+static const char kTypeTags[] = "ifsbhtdScmTFNI";
+
+Generator::Generator(uint64_t seed) :
+  state_(seed ? seed : 0x9e3779b97f4a7c15ull), escape_heavy_(false), tag_cycle_(0) {
+}
+
+/**
+ *  xorshift64*, the same sequence on every platform.
+ */
+uint32_t Generator::next() {
+  state_ ^= state_ >> 12;
+  state_ ^= state_ << 25;
+  state_ ^= state_ >> 27;
+  return (uint32_t)((state_ * 0x2545f4914f6cdd1dull) >> 32);
+}
+
+char Generator::text_char() {
+  if (escape_heavy_ && below(2) == 0) return below(2) ? (char)slip::kEnd : (char)slip::kEsc;
+  return "abcdefghijklmnopqrstuvwxyz0123456789_"[below(37)];
+}
+
+void Generator::text(char *out, int length) {
+  for (int i = 0; i < length; i++) out[i] = text_char();
+  out[length] = 0;
+}
+
+void Generator::address(char *out, int capacity) {
+  int o = 0;
+  int parts = 1 + below(4);
+  for (int p = 0; p < parts && o + 10 < capacity; p++) {
+    out[o++] = '/';
+    int n = 1 + below(8);
+    text(out + o, n);
+    o += n;
+  }
+  out[o] = 0;
+}
+
+void Generator::put_u32(std::vector<char> &out, uint32_t v) {
+  out.push_back((char)(v >> 24));
+  out.push_back((char)(v >> 16));
+  out.push_back((char)(v >> 8));
+  out.push_back((char)v);
+}
+
+void Generator::message(std::vector<char> &out, const char *typetags) {
+  char addr[64];
+  address(addr, sizeof(addr));
+  char tags[FOSC_MAX_ARGS + 1];
+  if (typetags == NULL) {
+    int n = below(FOSC_MAX_ARGS + 1);
+    for (int i = 0; i < n; i++) tags[i] = kTypeTags[below(sizeof(kTypeTags) - 1)];
+    tags[n] = 0;
+    typetags = tags;
+  }
+
+  // the largest argument is a 64 byte blob.
+  static char buffer[64 + FOSC_MAX_ARGS * 4 + 8 + FOSC_MAX_ARGS * 72];
+  osc::MessageIterator mi;
+  mi.encode(buffer, sizeof(buffer), addr, typetags);
+  for (const char *t = typetags; *t != 0; t++) {
+    char s[48];
+    uint8_t data[64];
+    switch (*t) {
+      case 'i': mi.append_i((int32_t)next()); break;
+      case 'f': mi.append_f((float)(int32_t)next() / 65536.0f); break;
+      case 's': text(s, below(40)); mi.append_s(s); break;
+      case 'S': text(s, below(40)); mi.append_S(s); break;
+      case 'b': {
+        int n = below(65);
+        for (int i = 0; i < n; i++) data[i] = escape_heavy_ ? (uint8_t)text_char() : (uint8_t)next();
+        mi.append_b(data, n);
+        break;
+      }
+      case 'h': mi.append_h(((int64_t)next() << 32) | next()); break;
+      case 't': { osc::TimeTag_t tt = { next(), next() }; mi.append_t(tt); break; }
+      case 'd': mi.append_d((double)(int32_t)next() / 3.0); break;
+      case 'c': mi.append_c(text_char()); break;
+      case 'm': { uint8_t midi[4] = { 0, 0x90, (uint8_t)below(128), (uint8_t)below(128) }; mi.append_m(midi); break; }
+      case 'T': mi.append_T(); break;
+      case 'F': mi.append_F(); break;
+      case 'N': mi.append_N(); break;
+      case 'I': mi.append_I(); break;
+    }
+  }
+  out.assign(buffer, buffer + mi.size());
+}
+
+void Generator::bundle(std::vector<char> &out, int depth, bool chain) {
+  static const char header[8] = {'#', 'b', 'u', 'n', 'd', 'l', 'e', 0};
+  out.assign(header, header + 8);
+  put_u32(out, next());
+  put_u32(out, next());
+
+  int elements = 1 + below(4);
+  int nested = chain && depth > 1 ? below(elements) : -1;
+  std::vector<char> element;
+  for (int i = 0; i < elements; i++) {
+    if (i == nested || (!chain && depth > 1 && below(3) == 0)) {
+      bundle(element, depth - 1, chain);
+    } else {
+      message(element);
+    }
+    put_u32(out, element.size());
+    out.insert(out.end(), element.begin(), element.end());
+  }
+}
+
+void Generator::slip(std::vector<char> &out, const std::vector<char> &packet) {
+  std::vector<uint8_t> frame(packet.size() * 2 + 1);
+  slip::Encoder encoder(&frame[0], frame.size());
+  encoder.pushBack((const uint8_t *)&packet[0], packet.size());
+  encoder.endPacket();
+  out.insert(out.end(), frame.begin(), frame.begin() + encoder.getSize());
+}
+
+void Generator::mutate(std::vector<char> &data, Kind_t kind) {
+  if (data.empty()) data.resize(4, 0);
+  int size = data.size();
+  int cases = kind == kCORPUS_SLIP ? 11 : 8;
+  switch (below(cases)) {
+    case 0: // truncate anywhere
+      data.resize(below(size));
+      break;
+    case 1: // truncate on a word
+      data.resize(below(size / 4 + 1) * 4);
+      break;
+    case 2: { // flip bits
+      int n = 1 + below(4);
+      for (int i = 0; i < n; i++) data[below(size)] ^= (char)(1 << below(8));
+      break;
+    }
+    case 3: { // a word that may be a size becomes huge, negative or unaligned
+      if (size < 4) break;
+      static const uint32_t sizes[] = { 0x7fffffff, 0xffffffff, 0x80000000, 3, 5, 0 };
+      int o = below(size / 4) * 4;
+      uint32_t v = sizes[below(6)];
+      data[o] = v >> 24; data[o + 1] = v >> 16; data[o + 2] = v >> 8; data[o + 3] = v;
+      break;
+    }
+    case 4: // strings lose their terminator
+      for (int i = 0; i < size; i++) if (data[i] == 0) data[i] = 'x';
+      break;
+    case 5: { // an unknown type tag
+      char *comma = (char *)memchr(&data[0], ',', size);
+      if (comma != NULL && comma + 1 < &data[0] + size) comma[1] = 'z';
+      break;
+    }
+    case 6: // garbage
+      for (int i = 0; i < size; i++) data[i] = (char)next();
+      break;
+    case 7: // trailing bytes
+      for (int i = 0; i < 4; i++) data.push_back((char)next());
+      break;
+    case 8: { // an escape followed by neither ESC_END nor ESC_ESC
+      int o = below(size);
+      data.insert(data.begin() + o, (char)slip::kEsc);
+      data.insert(data.begin() + o + 1, (char)below(0xdc));
+      break;
+    }
+    case 9: // a frame cut short by END
+      data.insert(data.begin() + below(size), (char)slip::kEnd);
+      break;
+    case 10: // a frame larger than any receive buffer
+      data.insert(data.begin(), 4096 + below(4096), 'a');
+      break;
+  }
+}
+
+void Generator::generate(int count, std::vector<Sample_t> &samples) {
+  std::vector<char> packet;
+  for (int i = 0; i < count; i++) {
+    Sample_t sample;
+    sample.kind = (Kind_t)(i % 3);
+    sample.valid = (i / 3) % 2 == 0;
+    set_escape_heavy(below(4) == 0);
+
+    switch (sample.kind) {
+      case kCORPUS_MESSAGE: {
+        // every type tag on its own first, then mixes.
+        char tags[2] = { kTypeTags[tag_cycle_ % (sizeof(kTypeTags) - 1)], 0 };
+        message(sample.data, tag_cycle_ < (int)sizeof(kTypeTags) - 1 ? tags : NULL);
+        tag_cycle_++;
+        break;
+      }
+      case kCORPUS_BUNDLE:
+        if (below(8) == 0) {
+          bundle(sample.data, FOSC_MAX_BUNDLE_DEPTH, true);
+        } else if (!sample.valid && below(4) == 0) {
+          // nested one level too deep, rejected by the validator.
+          bundle(sample.data, FOSC_MAX_BUNDLE_DEPTH + 1, true);
+          samples.push_back(sample);
+          continue;
+        } else {
+          bundle(sample.data, 1 + below(3));
+        }
+        break;
+      case kCORPUS_SLIP: {
+        int frames = 1 + below(4);
+        for (int f = 0; f < frames; f++) {
+          if (below(4) == 0) bundle(packet, 2); else message(packet);
+          slip(sample.data, packet);
+        }
+        break;
+      }
+    }
+    if (!sample.valid) mutate(sample.data, sample.kind);
+    samples.push_back(sample);
+  }
+}
+
+int fou::corpus::readArguments(osc::MessageIterator &mi) {
+  int n = mi.args_size();
+  const char *types = mi.types();
+  for (int k = 0; k < n; k++) {
+    switch (types[k]) {
+      case 'i': { int32_t v; mi.i(v); break; }
+      case 'f': { float v; mi.f(v); break; }
+      case 's': { char *v; mi.s(&v); break; }
+      case 'S': { char *v; mi.S(&v); break; }
+      case 'h': { int64_t v; mi.h(v); break; }
+      case 't': { osc::TimeTag_t v; mi.t(v); break; }
+      case 'd': { double v; mi.d(v); break; }
+      case 'c': { char v; mi.c(v); break; }
+      case 'm': { uint8_t v[4]; mi.m(v); break; }
+      case 'b': case 'T': case 'F': case 'N': case 'I':
+        mi.skip();
+        break;
+      default:
+        return -1;
+    }
+  }
+  return n;
+}
+
+bool fou::corpus::copyArguments(osc::MessageIterator &src, osc::MessageIterator &dst) {
+  int n = src.args_size();
+  const char *types = src.types();
+  for (int k = 0; k < n; k++) {
+    bool ok;
+    switch (types[k]) {
+      // words are copied as int32, so a float NaN or the upper bytes of a
+      // char survive.
+      case 'i': case 'f': case 'c': case 'm': { int32_t v; src.i(v); ok = dst.append_i(v); break; }
+      case 'h': case 't': case 'd': { int64_t v; src.h(v); ok = dst.append_h(v); break; }
+      case 's': case 'S': { char *v; src.s(&v); ok = dst.append_s(v); break; }
+      case 'b': {
+        int at = src.size();
+        int32_t size = src.b(NULL);
+        ok = dst.append_b((uint8_t *)src.address() + at + 4, size);
+        break;
+      }
+      case 'T': src.skip(); ok = dst.append_T(); break;
+      case 'F': src.skip(); ok = dst.append_F(); break;
+      case 'N': src.skip(); ok = dst.append_N(); break;
+      case 'I': src.skip(); ok = dst.append_I(); break;
+      default:
+        return false;
+    }
+    if (!ok) return false;
+  }
+  return true;
+}
+
+// every element of a decoded bundle, through BundleIterator::element().
+static int readElements(osc::BundleIterator &bi) {
+  int32_t sec, frac;
+  bi.timetag(sec, frac);
+
+  int messages = 0;
+  for (;;) {
+    if (bi.element_is_bundle()) {
+      osc::BundleIterator nested;
+      if (!bi.element(nested)) break;
+      messages += readElements(nested);
+    } else {
+      osc::MessageIterator mi;
+      if (!bi.element(mi)) break;
+      fou::corpus::readArguments(mi);
+      messages++;
+    }
+  }
+  return messages;
+}
+
+int fou::corpus::readBundle(char *buffer, int size) {
+  osc::BundleIterator bi;
+  if (!bi.decode(buffer, size)) return 0;
+  return readElements(bi);
+}
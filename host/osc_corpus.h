@@ -0,0 +1,126 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#ifndef FOU_OSC_CORPUS_H_
+#define FOU_OSC_CORPUS_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "fosc.h"
+
+namespace fou {
+namespace corpus {
+
+typedef enum {
+  kCORPUS_MESSAGE,
+  kCORPUS_BUNDLE,
+  kCORPUS_SLIP      /** a stream of SLIP frames */
+} Kind_t;
+
+typedef struct {
+  Kind_t kind;
+  bool valid;       /** false for adversarial samples */
+  std::vector<char> data;
+} Sample_t;
+
+/**
+ *  Generates OSC messages, bundles and SLIP streams from a seed, so the same
+ *  seed gives the same corpus on every run. Valid samples cover every type
+ *  tag, bundles nested to FOSC_MAX_BUNDLE_DEPTH and payloads full of SLIP
+ *  END and ESC bytes. Adversarial samples are valid ones that are truncated,
+ *  corrupted, nested too deep, or carry bad sizes, unknown type tags, 
+ *  missing terminators or bad escapes.
+ */
+class Generator {
+public:
+  explicit Generator(uint64_t seed);
+
+  /**
+   *  A valid message.
+   *  @param typetags the type tags, without ',', or NULL for random ones.
+   */
+  void message(std::vector<char> &out, const char *typetags = NULL);
+  /**
+   *  A valid bundle.
+   *  @param depth levels of bundles, 1 for a bundle of messages only.
+   *  @param chain nest exactly depth levels, instead of at most.
+   */
+  void bundle(std::vector<char> &out, int depth, bool chain = false);
+  /**
+   *  SLIP frame packets and append them to out.
+   */
+  void slip(std::vector<char> &out, const std::vector<char> &packet);
+  /**
+   *  Damage a sample in one of the ways a parser must survive.
+   */
+  void mutate(std::vector<char> &data, Kind_t kind);
+
+  /**
+   *  Append count samples, cycling through the kinds, half of them valid.
+   */
+  void generate(int count, std::vector<Sample_t> &samples);
+
+  inline void set_escape_heavy(bool on) { escape_heavy_ = on; };
+  uint32_t next();
+
+private:
+  inline uint32_t below(uint32_t n) { return n > 0 ? next() % n : 0; };
+  char text_char();
+  void address(char *out, int capacity);
+  void text(char *out, int length);
+  static void put_u32(std::vector<char> &out, uint32_t v);
+
+  uint64_t state_;
+  bool escape_heavy_;
+  int tag_cycle_;
+};
+
+/**
+ *  Read every argument of a decoded message, the way a handler would.
+ *  The message must have been validated.
+ *  @return the number of arguments, or -1 for an unknown type tag.
+ */
+int readArguments(osc::MessageIterator &mi);
+/**
+ *  Append every argument of a decoded message to a message being encoded
+ *  with the same type tags. Arguments are copied bit for bit.
+ *  The message must have been validated.
+ *  @return false for an unknown type tag, or when dst is full.
+ */
+bool copyArguments(osc::MessageIterator &src, osc::MessageIterator &dst);
+/**
+ *  Decode every message of a validated bundle, nested ones included, and
+ *  read their arguments.
+ *  @return the number of messages.
+ */
+int readBundle(char *buffer, int size);
+
+} } // end namespace fou / corpus
+
+#endif
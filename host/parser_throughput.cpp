@@ -0,0 +1,283 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+/*
+ *  Parser throughput regression check. Generates a corpus from a fixed seed
+ *  and measures MB/s through each parser. A run passes the corpus through
+ *  the parser until --min-ms has elapsed, and the median of the runs counts:
+ *
+ *    message  validateMessage(), MessageIterator::decode() and every argument
+ *    bundle   validateBundle() and every message in it
+ *    slip     slip::Decoder, a byte at a time
+ *    inplace  slip::InPlaceDecoder, in 1 kB reads
+ *
+ *    g++ -O2 -I ../arduino/serial_osc parser_throughput.cpp osc_corpus.cpp \
+ *        ../arduino/serial_osc/fosc.cpp ../arduino/serial_osc/fosc_validate.cpp \
+ *        -o parser_throughput
+ *
+ *    parser_throughput --save baseline.txt
+ *    parser_throughput --baseline baseline.txt --threshold 25
+ *
+ *  Options:
+ *    --count N        samples in the corpus, default 30000.
+ *    --seed N         corpus seed, default 1.
+ *    --repeat N       runs per parser, the median counts. Default 5.
+ *    --min-ms N       duration of a run in milliseconds, default 200.
+ *    --save FILE      write the results as a baseline.
+ *    --baseline FILE  compare with a baseline, exit with 1 when a parser is
+ *                     slower by more than the threshold.
+ *    --threshold PCT  allowed drop in percent, default 25. Runs on a shared
+ *                     machine vary by 10% and more.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "fosc.h"
+#include "fosc_validate.h"
+#include "slip.h"
+#include "osc_corpus.h"
+
+using namespace fou;
+
+static inline uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ *  The samples of one kind, packed into one buffer, each 4 byte aligned.
+ */
+struct Packed {
+  std::vector<char> data;
+  std::vector<int> offset;
+  std::vector<int> size;
+  uint64_t bytes;
+};
+
+static void pack(const std::vector<corpus::Sample_t> &samples, corpus::Kind_t kind, Packed &out) {
+  out.bytes = 0;
+  for (size_t i = 0; i < samples.size(); i++) {
+    if (samples[i].kind != kind) continue;
+    const std::vector<char> &d = samples[i].data;
+    out.offset.push_back(out.data.size());
+    out.size.push_back(d.size());
+    out.data.insert(out.data.end(), d.begin(), d.end());
+    out.data.resize((out.data.size() + 3) & ~3);
+    out.bytes += d.size();
+  }
+}
+
+// the parsers restore what they change, so runs are repeatable.
+static volatile int sink;
+
+static void run_messages(Packed &p) {
+  int n = 0;
+  for (size_t i = 0; i < p.offset.size(); i++) {
+    char *m = &p.data[p.offset[i]];
+    osc::MessageLayout_t layout;
+    if (osc::validateMessage(m, p.size[i], &layout) != osc::kFOSC_VALID) continue;
+    osc::MessageIterator mi;
+    mi.decode(m, layout);
+    n += corpus::readArguments(mi);
+  }
+  sink = n;
+}
+
+static void run_bundles(Packed &p) {
+  int n = 0;
+  for (size_t i = 0; i < p.offset.size(); i++) {
+    char *b = &p.data[p.offset[i]];
+    if (osc::validateBundle(b, p.size[i]) != osc::kFOSC_VALID) continue;
+    n += corpus::readBundle(b, p.size[i]);
+  }
+  sink = n;
+}
+
+static void run_slip(Packed &p) {
+  static uint8_t buffer[2048];
+  int n = 0;
+  for (size_t i = 0; i < p.offset.size(); i++) {
+    slip::Decoder decoder(buffer, sizeof(buffer));
+    const uint8_t *s = (const uint8_t *)&p.data[p.offset[i]];
+    for (int k = 0; k < p.size[i]; k++) {
+      decoder.pushBack(s[k]);
+      if (decoder.hasPacket()) {
+        n += decoder.getSize();
+        decoder.clear();
+      }
+    }
+  }
+  sink = n;
+}
+
+static void run_inplace(Packed &p) {
+  // unescaping happens in place, so work on a copy of every stream.
+  static uint8_t buffer[16384];
+  int n = 0;
+  for (size_t i = 0; i < p.offset.size(); i++) {
+    slip::InPlaceDecoder decoder(buffer, sizeof(buffer));
+    const uint8_t *s = (const uint8_t *)&p.data[p.offset[i]];
+    for (int o = 0; o < p.size[i]; ) {
+      int chunk = p.size[i] - o < 1024 ? p.size[i] - o : 1024;
+      uint8_t *tail = decoder.tail();
+      if (chunk > decoder.space()) chunk = decoder.space();
+      memcpy(tail, s + o, chunk);
+      decoder.commit(chunk);
+      o += chunk;
+      uint8_t *frame;
+      int size;
+      while (decoder.nextFrame(&frame, size)) n += size;
+    }
+  }
+  sink = n;
+}
+
+typedef struct {
+  const char *name;
+  double mbps;
+} Result_t;
+
+/**
+ *  @return the median MB/s of repeat runs of at least min_ms each.
+ */
+static double measure(void (*run)(Packed &), Packed &p, int repeat, int min_ms) {
+  run(p); // warm up the caches
+  std::vector<double> mbps;
+  for (int r = 0; r < repeat; r++) {
+    uint64_t t0 = now_ns();
+    uint64_t t = t0;
+    uint64_t passes = 0;
+    do {
+      run(p);
+      passes++;
+      t = now_ns();
+    } while (t - t0 < (uint64_t)min_ms * 1000000ull);
+    mbps.push_back(p.bytes * passes / ((t - t0) / 1e9) / 1e6);
+  }
+  std::sort(mbps.begin(), mbps.end());
+  return mbps[mbps.size() / 2];
+}
+
+static bool load_baseline(const char *path, std::vector<Result_t> &out, std::vector<std::string> &names) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) return false;
+  char name[64];
+  double mbps;
+  while (fscanf(f, "%63s %lf", name, &mbps) == 2) {
+    names.push_back(name);
+    Result_t r = { NULL, mbps };
+    out.push_back(r);
+  }
+  fclose(f);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  int count = 30000;
+  uint64_t seed = 1;
+  int repeat = 5;
+  int min_ms = 200;
+  const char *save = NULL;
+  const char *baseline = NULL;
+  double threshold = 25;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      fprintf(stderr, "usage: %s [--count N] [--seed N] [--repeat N] [--min-ms N] "
+                      "[--save FILE] [--baseline FILE] [--threshold PCT]\n", argv[0]);
+      return 2;
+    }
+    if (strcmp(argv[i], "--count") == 0) count = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--seed") == 0) seed = strtoull(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "--repeat") == 0) repeat = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--min-ms") == 0) min_ms = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--save") == 0) save = argv[++i];
+    else if (strcmp(argv[i], "--baseline") == 0) baseline = argv[++i];
+    else if (strcmp(argv[i], "--threshold") == 0) threshold = atof(argv[++i]);
+    else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (repeat < 1) repeat = 1;
+
+  corpus::Generator generator(seed);
+  std::vector<corpus::Sample_t> samples;
+  generator.generate(count, samples);
+  Packed messages, bundles, streams;
+  pack(samples, corpus::kCORPUS_MESSAGE, messages);
+  pack(samples, corpus::kCORPUS_BUNDLE, bundles);
+  pack(samples, corpus::kCORPUS_SLIP, streams);
+
+  Result_t results[] = {
+    { "message", measure(run_messages, messages, repeat, min_ms) },
+    { "bundle", measure(run_bundles, bundles, repeat, min_ms) },
+    { "slip", measure(run_slip, streams, repeat, min_ms) },
+    { "inplace", measure(run_inplace, streams, repeat, min_ms) }
+  };
+  const int kResults = sizeof(results) / sizeof(results[0]);
+
+  std::vector<Result_t> base;
+  std::vector<std::string> base_names;
+  if (baseline != NULL && !load_baseline(baseline, base, base_names)) {
+    perror(baseline);
+    return 2;
+  }
+
+  bool failed = false;
+  printf("%-8s %10s %10s %8s\n", "parser", "MB/s", "baseline", "change");
+  for (int i = 0; i < kResults; i++) {
+    printf("%-8s %10.1f", results[i].name, results[i].mbps);
+    for (size_t b = 0; b < base.size(); b++) {
+      if (base_names[b] != results[i].name) continue;
+      double change = (results[i].mbps - base[b].mbps) / base[b].mbps * 100;
+      bool slow = change < -threshold;
+      printf(" %10.1f %+7.1f%%%s", base[b].mbps, change, slow ? "  FAIL" : "");
+      failed |= slow;
+    }
+    printf("\n");
+  }
+
+  if (save != NULL) {
+    FILE *f = fopen(save, "w");
+    if (f == NULL) {
+      perror(save);
+      return 2;
+    }
+    for (int i = 0; i < kResults; i++) fprintf(f, "%s %.1f\n", results[i].name, results[i].mbps);
+    fclose(f);
+  }
+  return failed ? 1 : 0;
+}
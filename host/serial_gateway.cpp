@@ -0,0 +1,200 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#include "serial_gateway.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace fou::gateway;
+
+static inline uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static speed_t baud_to_speed(int baud) {
+  switch (baud) {
+    case 9600:    return B9600;
+    case 19200:   return B19200;
+    case 38400:   return B38400;
+    case 57600:   return B57600;
+    case 115200:  return B115200;
+    case 230400:  return B230400;
+    case 460800:  return B460800;
+    case 500000:  return B500000;
+    case 921600:  return B921600;
+    case 1000000: return B1000000;
+    case 2000000: return B2000000;
+    default:      return 0;
+  }
+}
+
+SerialGateway::Port::Port(int aFd, int buffer_size) :
+  fd(aFd), buffer(buffer_size), decoder(&buffer[0], buffer_size) {
+}
+
+SerialGateway::SerialGateway(FrameHandler handler, void *context, int buffer_size, int read_budget) :
+  handler_(handler), context_(context), buffer_size_(buffer_size),
+  read_budget_(read_budget > 0 ? read_budget : 1), events_(64) {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  reset_stats();
+}
+
+SerialGateway::~SerialGateway() {
+  for (int i = 0; i < (int)ports_.size(); i++) remove_port(i);
+  if (epoll_fd_ >= 0) close(epoll_fd_);
+}
+
+bool SerialGateway::configure(int fd, int baud) {
+  struct termios tio;
+  if (tcgetattr(fd, &tio) != 0) return false;
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  if (baud > 0) {
+    speed_t speed = baud_to_speed(baud);
+    if (speed == 0) return false;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+  }
+  return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+int SerialGateway::open_port(const char *path, int baud) {
+  int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) return -1;
+  if (!configure(fd, baud)) {
+    close(fd);
+    return -1;
+  }
+  return add_port(fd);
+}
+
+int SerialGateway::add_port(int fd) {
+  if (epoll_fd_ < 0) return -1;
+  int flags = fcntl(fd, F_GETFL);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) return -1;
+
+  int port = (int)ports_.size();
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.u32 = port;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) return -1;
+  ports_.push_back(new Port(fd, buffer_size_));
+  PortStats_t zero;
+  memset(&zero, 0, sizeof(zero));
+  stats_.push_back(zero);
+  if (events_.size() < ports_.size()) events_.resize(ports_.size());
+  return port;
+}
+
+void SerialGateway::remove_port(int port) {
+  if (port < 0 || port >= (int)ports_.size() || ports_[port] == NULL) return;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, ports_[port]->fd, NULL);
+  close(ports_[port]->fd);
+  delete ports_[port];
+  ports_[port] = NULL;
+}
+
+const PortStats_t &SerialGateway::port_stats(int port) const {
+  static const PortStats_t none = {0, 0, 0, 0};
+  if (port < 0 || port >= (int)stats_.size()) return none;
+  return stats_[port];
+}
+
+void SerialGateway::reset_stats() {
+  memset(&loop_stats_, 0, sizeof(loop_stats_));
+  for (int i = 0; i < (int)stats_.size(); i++) {
+    memset(&stats_[i], 0, sizeof(PortStats_t));
+  }
+}
+
+/**
+ *  Read up to read_budget_ times from a port and forward the complete frames.
+ *  @return the number of frames, or -1 when the port has been closed.
+ */
+int SerialGateway::drain(int port) {
+  Port *p = ports_[port];
+  int frames = 0;
+  for (int reads = 0; reads < read_budget_; ) {
+    uint8_t *tail = p->decoder.tail(); // before space(), it compacts
+    ssize_t n = read(p->fd, tail, p->decoder.space());
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      if (n < 0 && errno == EAGAIN) break;
+      // end of file or a hang up.
+      stats_[port].errors = p->decoder.errors();
+      remove_port(port);
+      return -1;
+    }
+    reads++;
+    stats_[port].bytes += n;
+    stats_[port].reads++;
+    p->decoder.commit((int)n);
+
+    uint8_t *frame;
+    int size;
+    while (p->decoder.nextFrame(&frame, size)) {
+      handler_(port, frame, size, context_);
+      frames++;
+      stats_[port].frames++;
+      // the handler may have removed the port.
+      if (ports_[port] != p) return frames;
+    }
+    stats_[port].errors = p->decoder.errors();
+  }
+  return frames;
+}
+
+int SerialGateway::poll(int timeout_ms) {
+  uint64_t t0 = now_ns();
+  int n = epoll_wait(epoll_fd_, &events_[0], (int)events_.size(), timeout_ms);
+  uint64_t t1 = now_ns();
+  loop_stats_.iterations++;
+  loop_stats_.wait_ns += t1 - t0;
+  if (n < 0) return errno == EINTR ? 0 : -1;
+  loop_stats_.events += n;
+
+  int frames = 0;
+  for (int i = 0; i < n; i++) {
+    int port = events_[i].data.u32;
+    if (port >= (int)ports_.size() || ports_[port] == NULL) continue;
+    int r = drain(port);
+    if (r > 0) frames += r;
+  }
+  loop_stats_.work_ns += now_ns() - t1;
+  return frames;
+}
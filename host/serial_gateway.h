@@ -0,0 +1,162 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#ifndef FOU_SERIAL_GATEWAY_H_
+#define FOU_SERIAL_GATEWAY_H_
+
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <vector>
+
+#include "slip.h"
+
+namespace fou {
+namespace gateway {
+
+/**
+ *  Counters of one port.
+ */
+typedef struct {
+  uint64_t bytes;   /** bytes read */
+  uint64_t reads;   /** read() calls that returned data */
+  uint64_t frames;  /** frames forwarded */
+  uint64_t errors;  /** frames dropped by the SLIP decoder */
+} PortStats_t;
+
+/**
+ *  Counters of the event loop. work_ns is the cost of the loop, wait_ns is
+ *  mostly idle time blocked in epoll_wait() and says little about it.
+ */
+typedef struct {
+  uint64_t iterations; /** calls to epoll_wait() */
+  uint64_t events;     /** ready descriptors returned */
+  uint64_t wait_ns;    /** time spent in epoll_wait(), including idle blocking */
+  uint64_t work_ns;    /** time spent reading, decoding and forwarding */
+} LoopStats_t;
+
+/**
+ *  Multiplexes many serial ports, each carrying SLIP framed OSC, on a single
+ *  epoll loop. Every port has its own receive buffer that frames are
+ *  unescaped in, with slip::InPlaceDecoder, and complete frames are handed to
+ *  the handler tagged with the port id.
+ *
+ *  Linux only. Ports can be real ttys, opened with open_port(), or any
+ *  descriptor such as one side of an openpty() pair, added with add_port().
+ *
+ *  A port is read at most read_budget() times per poll(), so one busy port
+ *  cannot starve the others. What is left is reported again by the next
+ *  epoll_wait(). The counters of a port are kept after it is removed.
+ */
+class SerialGateway {
+public:
+  /**
+   *  Called for every complete frame. The frame is valid during the call only.
+   */
+  typedef void (*FrameHandler)(int port, uint8_t *frame, int size, void *context);
+
+  /**
+   *  Constructor.
+   *  @param handler called for every frame.
+   *  @param context passed to the handler.
+   *  @param buffer_size receive buffer per port, the largest frame that fits.
+   *  @param read_budget read() calls per port per poll().
+   */
+  SerialGateway(FrameHandler handler, void *context, int buffer_size = 1024, int read_budget = 4);
+  ~SerialGateway();
+
+  /**
+   *  Open a tty and configure it.
+   *  @param path the device.
+   *  @param baud the baud rate, e.g. 115200.
+   *  @return the port id, or -1 on error.
+   */
+  int open_port(const char *path, int baud);
+  /**
+   *  Add an open descriptor. It is made non blocking, the gateway owns it
+   *  from now on.
+   *  @return the port id, or -1 on error.
+   */
+  int add_port(int fd);
+  /**
+   *  Stop polling a port and close its descriptor. Its id is not reused and
+   *  its counters stay available.
+   */
+  void remove_port(int port);
+
+  /**
+   *  Put a tty in raw mode, 8N1, no flow control, at the given baud rate.
+   *  @return true on success.
+   */
+  static bool configure(int fd, int baud);
+
+  /**
+   *  Wait for data on any port and forward the complete frames.
+   *  @param timeout_ms as for epoll_wait(), -1 waits forever.
+   *  @return the number of frames forwarded, or -1 on error.
+   */
+  int poll(int timeout_ms);
+
+  inline int ports() const { return (int)ports_.size(); };
+  inline int fd(int port) const { return ports_[port] ? ports_[port]->fd : -1; };
+  inline int read_budget() const { return read_budget_; };
+  inline void set_read_budget(int reads) { read_budget_ = reads > 0 ? reads : 1; };
+  /**
+   *  @return the counters of a port, also after it has been removed. An
+   *  unknown port id returns zeros.
+   */
+  const PortStats_t &port_stats(int port) const;
+  inline const LoopStats_t &loop_stats() const { return loop_stats_; };
+  void reset_stats();
+
+private:
+  struct Port {
+    Port(int fd, int buffer_size);
+    int fd;
+    std::vector<uint8_t> buffer;
+    slip::InPlaceDecoder decoder;
+  };
+
+  int drain(int port);
+
+  SerialGateway(const SerialGateway &);
+  SerialGateway &operator=(const SerialGateway &);
+
+  FrameHandler handler_;
+  void *context_;
+  int buffer_size_;
+  int read_budget_;
+  int epoll_fd_;
+  std::vector<Port *> ports_; // NULL once removed
+  std::vector<PortStats_t> stats_; // per port id, outlives the Port
+  std::vector<struct epoll_event> events_;
+  LoopStats_t loop_stats_;
+};
+
+} } // end namespace fou / gateway
+
+#endif
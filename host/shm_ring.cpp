@@ -0,0 +1,311 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#include "shm_ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <new>
+
+using namespace fou::gateway;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "the ring needs lock free atomics to be shared between processes");
+
+static const uint32_t kMagic = 0x4f534352;        // "OSCR"
+static const uint32_t kCommitted = 0x80000000u;
+static const uint32_t kPadding = 0x40000000u;
+static const uint32_t kLengthMask = 0x3fffffffu;
+
+/**
+ *  Start of the mapping. The data follows on the next page. Fields written by
+ *  producers and by the consumer live on separate cache lines.
+ */
+struct ShmRing::Header {
+  uint32_t magic;
+  uint32_t capacity;
+  alignas(64) std::atomic<uint64_t> tail;      // reserved by producers
+  std::atomic<uint64_t> full;
+  std::atomic<uint64_t> wakes;
+  alignas(64) std::atomic<uint64_t> head;      // released by the consumer
+  std::atomic<uint64_t> records;
+  std::atomic<uint64_t> sleeps;
+  alignas(64) std::atomic<uint32_t> sleeping;  // the futex word
+};
+
+static inline uint32_t align4(uint32_t n) {
+  return (n + 3) & ~3u;
+}
+
+static inline uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+static inline uint32_t load_header(const uint8_t *p) {
+  return __atomic_load_n((const uint32_t *)p, __ATOMIC_ACQUIRE);
+}
+
+static inline void store_header(uint8_t *p, uint32_t v) {
+  __atomic_store_n((uint32_t *)p, v, __ATOMIC_RELEASE);
+}
+
+size_t ShmRing::header_size() {
+  size_t page = sysconf(_SC_PAGESIZE);
+  return (sizeof(ShmRing::Header) + page - 1) / page * page;
+}
+
+ShmRing::ShmRing() :
+  fd_(-1), header_(NULL), data_(NULL), capacity_(0), mapped_(0), spin_ns_(50000) {
+}
+
+ShmRing::~ShmRing() {
+  close();
+}
+
+bool ShmRing::create(const char *name, uint32_t capacity) {
+  if (capacity < 64 || capacity > kLengthMask || (capacity & (capacity - 1)) != 0) return false;
+  close();
+  int fd;
+  if (name != NULL) {
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  } else {
+    fd = syscall(SYS_memfd_create, "osc-ring", MFD_CLOEXEC);
+  }
+  if (fd < 0) return false;
+  if (ftruncate(fd, header_size() + capacity) < 0 || !map(fd, true, capacity)) {
+    ::close(fd);
+    if (name != NULL) shm_unlink(name);
+    return false;
+  }
+  return true;
+}
+
+bool ShmRing::open(const char *name) {
+  close();
+  int fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+  if (fd < 0) return false;
+  if (!map(fd, false, 0)) {
+    ::close(fd);
+    return false;
+  }
+  return true;
+}
+
+bool ShmRing::attach(int fd) {
+  close();
+  int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  if (dup_fd < 0) return false;
+  if (!map(dup_fd, false, 0)) {
+    ::close(dup_fd);
+    return false;
+  }
+  return true;
+}
+
+bool ShmRing::map(int fd, bool init, uint32_t capacity) {
+  if (!init) {
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size <= header_size()) return false;
+    capacity = st.st_size - header_size();
+  }
+  size_t size = header_size() + capacity;
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) return false;
+
+  Header *h = (Header *)p;
+  if (init) {
+    // a new mapping is zero filled, which is what the data must start as.
+    new (h) Header();
+    h->capacity = capacity;
+    h->tail.store(0);
+    h->head.store(0);
+    h->full.store(0);
+    h->wakes.store(0);
+    h->records.store(0);
+    h->sleeps.store(0);
+    h->sleeping.store(0);
+    __atomic_store_n(&h->magic, kMagic, __ATOMIC_RELEASE);
+  } else if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != kMagic || h->capacity != capacity) {
+    munmap(p, size);
+    return false;
+  }
+
+  fd_ = fd;
+  header_ = h;
+  data_ = (uint8_t *)p + header_size();
+  capacity_ = capacity;
+  mapped_ = size;
+  return true;
+}
+
+void ShmRing::close() {
+  if (header_ != NULL) munmap(header_, mapped_);
+  if (fd_ >= 0) ::close(fd_);
+  fd_ = -1;
+  header_ = NULL;
+  data_ = NULL;
+  capacity_ = 0;
+  mapped_ = 0;
+}
+
+bool ShmRing::unlink(const char *name) {
+  return shm_unlink(name) == 0;
+}
+
+bool ShmRing::write(const void *data, int size) {
+  if (size < 0) return false;
+  uint32_t need = 4 + align4(size);
+  if (need > capacity_ / 2) return false;
+
+  uint32_t mask = capacity_ - 1;
+  uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+  uint32_t pad;
+  for (;;) {
+    uint32_t offset = tail & mask;
+    pad = capacity_ - offset < need ? capacity_ - offset : 0;
+    uint64_t head = header_->head.load(std::memory_order_acquire);
+    if (tail + pad + need - head > capacity_) {
+      header_->full.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    if (header_->tail.compare_exchange_weak(tail, tail + pad + need,
+                                            std::memory_order_relaxed)) break;
+  }
+
+  if (pad > 0) {
+    store_header(data_ + (tail & mask), kCommitted | kPadding | pad);
+    tail += pad;
+  }
+  uint8_t *record = data_ + (tail & mask);
+  memcpy(record + 4, data, size);
+  // the consumer zeroed the record, so the padding already is.
+  store_header(record, kCommitted | size);
+  wake();
+  return true;
+}
+
+void ShmRing::wake() {
+  // pairs with the fence in wait(): either the consumer sees the record, or
+  // this sees it sleeping.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (header_->sleeping.load(std::memory_order_relaxed) != 0 &&
+      header_->sleeping.exchange(0) != 0) {
+    header_->wakes.fetch_add(1, std::memory_order_relaxed);
+    syscall(SYS_futex, &header_->sleeping, FUTEX_WAKE, 1, NULL, NULL, 0);
+  }
+}
+
+bool ShmRing::ready() const {
+  uint64_t head = header_->head.load(std::memory_order_relaxed);
+  return (load_header(data_ + (head & (capacity_ - 1))) & kCommitted) != 0;
+}
+
+int ShmRing::poll(RecordHandler handler, void *context, int max) {
+  uint32_t mask = capacity_ - 1;
+  uint64_t head = header_->head.load(std::memory_order_relaxed);
+  int count = 0;
+  while (count < max) {
+    uint8_t *record = data_ + (head & mask);
+    uint32_t h = load_header(record);
+    if ((h & kCommitted) == 0) break;
+    uint32_t length = h & kLengthMask;
+    uint32_t size;
+    if (h & kPadding) {
+      size = length;
+    } else {
+      handler((char *)record + 4, length, context);
+      size = 4 + align4(length);
+      count++;
+    }
+    memset(record, 0, size);
+    head += size;
+    header_->head.store(head, std::memory_order_release);
+  }
+  if (count > 0) header_->records.fetch_add(count, std::memory_order_relaxed);
+  return count;
+}
+
+int ShmRing::wait(RecordHandler handler, void *context, int timeout_ms) {
+  uint64_t start = now_ns();
+  uint64_t deadline = timeout_ms < 0 ? UINT64_MAX : start + (uint64_t)timeout_ms * 1000000ull;
+  for (;;) {
+    int n = poll(handler, context);
+    if (n > 0) return n;
+    uint64_t now = now_ns();
+    if (now >= deadline) return 0;
+    if (spin_ns_ < 0 || now - start < (uint64_t)spin_ns_) {
+      cpu_relax();
+      continue;
+    }
+
+    header_->sleeping.store(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ready()) {
+      header_->sleeping.store(0);
+      continue;
+    }
+    header_->sleeps.fetch_add(1, std::memory_order_relaxed);
+    struct timespec ts;
+    struct timespec *timeout = NULL;
+    if (timeout_ms >= 0) {
+      uint64_t left = deadline - now;
+      ts.tv_sec = left / 1000000000ull;
+      ts.tv_nsec = left % 1000000000ull;
+      timeout = &ts;
+    }
+    syscall(SYS_futex, &header_->sleeping, FUTEX_WAIT, 1, timeout, NULL, 0);
+    header_->sleeping.store(0);
+  }
+}
+
+RingStats_t ShmRing::stats() const {
+  RingStats_t s;
+  s.records = header_->records.load();
+  s.full = header_->full.load();
+  s.sleeps = header_->sleeps.load();
+  s.wakes = header_->wakes.load();
+  return s;
+}
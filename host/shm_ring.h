@@ -0,0 +1,160 @@
+/*
+ *
+ This file is part of Fou.
+ 
+ The MIT License (MIT)
+ 
+ Copyright (C) 2010  Daniel Saakes
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ *
+ */
+
+#ifndef FOU_SHM_RING_H_
+#define FOU_SHM_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace fou {
+namespace gateway {
+
+/**
+ *  Counters of a ring, shared by all processes that map it.
+ */
+typedef struct {
+  uint64_t records;  /** records read by the consumer */
+  uint64_t full;     /** writes refused because the ring was full */
+  uint64_t sleeps;   /** times the consumer went to sleep on the futex */
+  uint64_t wakes;    /** futex wakes issued by producers */
+} RingStats_t;
+
+/**
+ *  A ring of variable length records in shared memory, for OSC between
+ *  processes on one host. Any number of producers, in any process, write
+ *  records. A single consumer reads them in place, so a record can be
+ *  handed to MessageIterator or BundleIterator without a copy.
+ *
+ *  Records start on a 4 byte boundary with a 4 byte header and never wrap:
+ *  a record that does not fit before the end of the ring is preceded by a
+ *  padding record. Producers reserve space with a compare and exchange on
+ *  the tail and publish the header last. The consumer zeroes what it has
+ *  read, so a header word is only ever non zero once it is published.
+ *
+ *  An idle consumer spins for a while, then sleeps on a futex in the shared
+ *  mapping. Producers only make the wake system call when it sleeps. With
+ *  set_spin(-1) the consumer never sleeps.
+ *
+ *  The ring is backed by shm_open() when it has a name, or by memfd_create()
+ *  when it does not. In that case the descriptor is shared by fork() or sent
+ *  over a unix socket, and attach() maps it.
+ *
+ *    // consumer
+ *    ShmRing ring;
+ *    ring.create("/osc", 1 << 20);
+ *    for (;;) ring.wait(on_record, NULL, -1);
+ *
+ *    // producer, in another process
+ *    ShmRing ring;
+ *    ring.open("/osc");
+ *    ring.write(msg.data(), msg.size());
+ */
+class ShmRing {
+public:
+  /**
+   *  Called for every record. The record is valid during the call only.
+   */
+  typedef void (*RecordHandler)(char *data, int size, void *context);
+
+  ShmRing();
+  ~ShmRing();
+
+  /**
+   *  Create a ring.
+   *  @param name for shm_open(), e.g. "/osc", or NULL for an anonymous ring.
+   *  @param capacity in bytes, a power of two.
+   *  @return true on success.
+   */
+  bool create(const char *name, uint32_t capacity);
+  /**
+   *  Map a ring created by another process.
+   */
+  bool open(const char *name);
+  /**
+   *  Map a ring from a descriptor, e.g. fd() of an anonymous ring. The
+   *  descriptor is duplicated.
+   */
+  bool attach(int fd);
+  void close();
+  /**
+   *  Remove a named ring. Processes that have it mapped keep it.
+   */
+  static bool unlink(const char *name);
+
+  /**
+   *  Append a record, from any thread or process.
+   *  @return false when the ring is full or the record can never fit.
+   */
+  bool write(const void *data, int size);
+
+  /**
+   *  Hand all records that are ready to the handler, without blocking.
+   *  Only one thread may consume.
+   *  @param max the most records to handle.
+   *  @return the number of records handled.
+   */
+  int poll(RecordHandler handler, void *context, int max = 0x7fffffff);
+  /**
+   *  Like poll(), but waits for at least one record. It spins first, then
+   *  sleeps.
+   *  @param timeout_ms -1 waits forever.
+   *  @return the number of records handled, 0 on a timeout.
+   */
+  int wait(RecordHandler handler, void *context, int timeout_ms);
+
+  /**
+   *  How long wait() spins before it sleeps, -1 to spin forever.
+   */
+  inline void set_spin(int64_t ns) { spin_ns_ = ns; };
+  inline int fd() const { return fd_; };
+  inline uint32_t capacity() const { return capacity_; };
+  RingStats_t stats() const;
+
+private:
+  struct Header;
+
+  static size_t header_size();
+  bool map(int fd, bool init, uint32_t capacity);
+  bool ready() const;
+  void wake();
+
+  ShmRing(const ShmRing &);
+  ShmRing &operator=(const ShmRing &);
+
+  int fd_;
+  Header *header_;
+  uint8_t *data_;
+  uint32_t capacity_;
+  size_t mapped_;
+  int64_t spin_ns_;
+};
+
+} } // end namespace fou / gateway
+
+#endif